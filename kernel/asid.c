@@ -0,0 +1,172 @@
+//
+// Address-space identifiers.
+//
+// Each process's page table runs under its own ASID, so that
+// entering and leaving the kernel (ASID 0) need not flush the
+// TLB: trampoline.S just switches satp. ASIDs are handed out in
+// generations. When a generation's ASIDs are used up, a new one
+// begins, every process gets a new ASID the next time it returns
+// to user space, and each hart flushes its whole TLB once before
+// using any ASID of the new generation.
+//
+// The kernel only changes a process's page table while that
+// process is in the kernel, so a change made by the process
+// itself need only be flushed before it returns to user space:
+// tlbstale() notes it, and asidsatp() flushes the ASID. reclaim()
+// changes the page tables of processes that aren't running, and
+// sets their p->tlbstale itself. A process that moves to another
+// hart flushes its ASID there too, since that hart's TLB may hold
+// entries from when it last ran there. exec() switches to a fresh
+// ASID for the new page table.
+//
+// asidsatp() runs on every return to user space, so it only takes
+// asid.lock to hand out an ASID or to catch up with a new
+// generation; otherwise it works from the process's and the
+// hart's own state, and counts in per-hart counters.
+//
+// If the hardware has no ASIDs (or they are turned off with
+// tlbstat()), every trap flushes the whole TLB, as before.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "asid.h"
+
+struct {
+  struct spinlock lock;
+  uint64 gen;        // current generation; 0 is never current.
+                     //   written with asid.lock held, read without
+  uint next;         // next ASID to hand out in this generation
+  struct tlbstat st;
+} asid;
+
+// Find out how many ASIDs the hardware supports, by writing
+// all ones to the ASID field of satp and reading back the bits
+// that stick. Called on hart 0 after kvminithart().
+void
+asidinit(void)
+{
+  uint64 satp = r_satp();
+
+  initlock(&asid.lock, "asid");
+  w_satp(satp | SATP_ASID(SATP_ASIDMAX));
+  asid.st.nasid = ((r_satp() >> SATP_ASIDSHIFT) & SATP_ASIDMAX) + 1;
+  w_satp(satp);
+  sfence_vma();
+  asid.st.on = asid.st.nasid > 1;
+  asid.gen = 1;
+  asid.next = 1;   // ASID 0 is the kernel's
+}
+
+// Begin a new generation. Caller holds asid.lock.
+static void
+newgen(void)
+{
+  asid.next = 1;
+  __atomic_store_n(&asid.gen, asid.gen + 1, __ATOMIC_RELEASE);
+}
+
+// Give p a new ASID the next time it returns to user space,
+// for exec(), which replaces p's page table.
+void
+asidreset(struct proc *p)
+{
+  p->asidgen = 0;
+}
+
+// The current process may have changed pagetable. If it is the
+// process's own page table, flush its ASID before the process
+// next returns to user space.
+void
+tlbstale(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    p->tlbstale = 1;
+}
+
+// Return the satp value for p to return to user space with,
+// flushing whatever it needs from this hart's TLB. Sets *flush
+// if trampoline.S must flush the whole TLB around each switch
+// of satp instead. Called with interrupts off.
+uint64
+asidsatp(struct proc *p, int *flush)
+{
+  struct cpu *c = mycpu();
+  int hart = cpuid();
+  uint64 gen;
+
+  c->ntrap++;
+  if(!__atomic_load_n(&asid.st.on, __ATOMIC_RELAXED)){
+    // one flush on the way out, and one on the next way in.
+    c->nfullflush += 2;
+    p->tlbstale = 0;
+    *flush = 1;
+    return MAKE_SATP(p->pagetable);
+  }
+
+  gen = __atomic_load_n(&asid.gen, __ATOMIC_ACQUIRE);
+  if(p->asidgen != gen || c->asidgen != gen){
+    acquire(&asid.lock);
+    if(p->asidgen != asid.gen){
+      if(asid.next >= asid.st.nasid){
+        newgen();
+        asid.st.rollovers++;
+      }
+      p->asid = asid.next++;
+      p->asidgen = asid.gen;
+      p->asidhart = -1;
+    }
+    gen = p->asidgen;
+    release(&asid.lock);
+  }
+  // if another hart has begun a newer generation since, p keeps
+  // its ASID until its next return to user space, and this hart
+  // flushes its whole TLB before running any ASID of that one.
+  if(c->asidgen != gen){
+    sfence_vma();
+    c->nfullflush++;
+    c->asidgen = gen;
+  } else if(p->tlbstale || p->asidhart != hart){
+    sfence_vma_asid(p->asid);
+    c->nasidflush++;
+  }
+  p->tlbstale = 0;
+  p->asidhart = hart;
+
+  *flush = 0;
+  return MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
+}
+
+uint64
+sys_tlbstat(void)
+{
+  uint64 addr;
+  int on, i;
+  struct tlbstat st;
+
+  argaddr(0, &addr);
+  argint(1, &on);
+  acquire(&asid.lock);
+  if(on >= 0 && asid.st.nasid > 1 && on != asid.st.on){
+    asid.st.on = on;
+    // make every hart flush before it uses an ASID again.
+    newgen();
+  }
+  st = asid.st;
+  release(&asid.lock);
+  for(i = 0; i < NCPU; i++){
+    st.traps += cpus[i].ntrap;
+    st.fullflush += cpus[i].nfullflush;
+    st.asidflush += cpus[i].nasidflush;
+  }
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,9 @@
+// TLB statistics, returned by the tlbstat() system call.
+struct tlbstat {
+  uint nasid;        // ASIDs the hardware supports; 0 or 1 if none
+  int on;            // user page tables run under their own ASIDs
+  uint64 traps;      // returns to user space
+  uint64 fullflush;  // flushes of the whole TLB
+  uint64 asidflush;  // flushes of one process's ASID
+  uint64 rollovers;  // ASID generations used up
+};
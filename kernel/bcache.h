@@ -0,0 +1,24 @@
+// Buffer cache statistics, returned by the bcachestat() system call.
+struct bcachestat {
+  uint nbuf;                    // buffers
+  uint maxbuf;                  // limit the cache grows to
+  uint nbucket;                 // hash buckets
+  int twoq;                     // 2Q replacement, rather than CLOCK
+  uint na1;                     // buffers on the A1 (seen once) queue
+  uint nam;                     // buffers on the Am (seen again) queue
+  uint64 hits;                  // bget()s that found the block cached
+  uint64 misses;                //   and that had to read it
+  uint64 ghosthits;             // misses on blocks recently evicted from A1
+  uint64 grows;                 // pages of buffers added
+  uint64 shrinks;               // pages of buffers given back
+  int ramax;                    // largest read-ahead window, in blocks
+  uint64 rastarts;              // blocks read ahead
+  uint64 rahits;                //   that were then used
+  uint64 rawasted;              //   that were evicted unused
+  int maxseg;                   // most blocks in one disk request
+  uint64 nreq;                  // disk requests
+  uint64 nreqblocks;            //   and the blocks they moved
+  uint64 nacquire[NBUCKET+1];   // acquires of each bucket's lock, then
+                                //   of the miss lock
+  uint64 ncontend[NBUCKET+1];   // failed test-and-sets waiting for them
+};
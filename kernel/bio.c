@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -12,44 +12,304 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
-
+//
+// Buffers are hashed by (dev, blockno) into NBUCKET chains, each
+// with its own lock, so that hits on different blocks, brelse(),
+// bpin() and bunpin() don't contend.
+//
+// Buffers live in pages of BUFPERSLAB, allocated with kalloc().
+// binit() sizes the cache from the free memory at boot, a miss
+// adds a page of buffers while the cache is below bcache.maxbuf
+// and memory is plentiful, and bshrink() gives pages back when
+// kallocreclaim() runs out of memory.
+//
+// Replacement is 2Q, so that one pass over a large file doesn't
+// flush blocks that are used over and over, like inodes and
+// bitmaps. A block read for the first time goes on the A1 queue,
+// which is FIFO and kept to about a quarter of the cache; a miss
+// on a block that was recently evicted from A1 (it is in the ghost
+// table) puts it on the Am queue, which is managed by CLOCK, an
+// approximation of LRU: brelse() only sets b->ref. A block read
+// once is evicted from A1 before it can push anything out of Am.
+//
+// readi() reads ahead of sequential reads with breadahead(),
+// which starts reading a block without waiting for it. The
+// buffer stays locked until the disk interrupt calls bdone().
+//
+// Reads and writes go through the disk scheduler (iosched.c).
+// bwritestartv() queues a batch of writes at once, so that the
+// scheduler can order them and merge consecutive blocks into
+// large requests.
+//
+// Misses hold bcache.lock, which protects the queues, the ghost
+// table and the pages of buffers, and take bucket locks after it,
+// one at a time. Hits take only a bucket lock, and never
+// bcache.lock while they hold it, so there is no lock cycle.
 
 #include "types.h"
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "bcache.h"
+
+extern int readaheadmax;
+extern int iomaxseg;
+
+#define NGHOST  1024  // entries in the ghost table
+#define BSHRINK 16    // pages bshrink() frees per call
+
+// A page of buffers.
+struct bslab {
+  struct bslab *next;
+  struct buf buf[];
+};
+
+#define BUFPERSLAB ((PGSIZE - sizeof(struct bslab)) / sizeof(struct buf))
+
+// b->queue
+#define QFREE 0   // no block; not hashed
+#define QA1   1   // blocks seen once, FIFO
+#define QAM   2   // blocks seen again, CLOCK
+
+struct bqueue {
+  struct buf *head;   // most recently added
+  struct buf *tail;
+  int n;
+};
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *chain;  // through hnext
+  uint64 hits;
+  uint64 rastarts;    // reads started by breadahead()
+  uint64 rahits;      // hits on blocks read ahead
+};
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct bslab *slabs;
+  int nbuf;
+  int maxbuf;           // the cache grows up to this many buffers
+  int twoq;             // 0: everything goes on Am, as plain CLOCK
+  uint lowfree;         // only grow while more pages than this are free
+  struct bqueue q[3];   // indexed by b->queue
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+  // (dev, blockno) of blocks recently evicted from A1,
+  // direct-mapped by ghosthash().
+  struct { uint dev, blockno; } ghost[NGHOST];
+
+  uint64 misses;
+  uint64 ghosthits;
+  uint64 grows;         // pages of buffers added
+  uint64 shrinks;       // pages of buffers freed
+  uint64 rawasted;      // blocks read ahead but evicted unused
+  struct bucket bucket[NBUCKET];
+
+  struct sleeplock statlock; // protects st
+  struct bcachestat st;      // for bcachestat(), too big for a kernel stack
 } bcache;
 
+static struct bucket*
+hash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+static int
+ghosthash(uint dev, uint blockno)
+{
+  return (dev * 31 + blockno) % NGHOST;
+}
+
+// Queue operations. Caller must hold bcache.lock.
+
+static void
+qpush(int k, struct buf *b)
+{
+  struct bqueue *q = &bcache.q[k];
+
+  b->queue = k;
+  b->prev = 0;
+  b->next = q->head;
+  if(q->head)
+    q->head->prev = b;
+  else
+    q->tail = b;
+  q->head = b;
+  q->n++;
+}
+
+static void
+qremove(struct buf *b)
+{
+  struct bqueue *q = &bcache.q[b->queue];
+
+  if(b->prev)
+    b->prev->next = b->next;
+  else
+    q->head = b->next;
+  if(b->next)
+    b->next->prev = b->prev;
+  else
+    q->tail = b->prev;
+  q->n--;
+}
+
+// Remove b from its hash chain. Caller must hold its bucket's lock.
+static void
+unhash(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->chain; *pp != b; pp = &(*pp)->hnext)
+    ;
+  *pp = b->hnext;
+  b->bucket = -1;
+}
+
+// Return the cached buffer for dev, blockno in bk, with a
+// reference taken, or 0. Caller must hold bk->lock.
+static struct buf*
+lookup(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->chain; b; b = b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      bk->hits++;
+      if(b->readahead){
+        b->readahead = 0;
+        bk->rahits++;
+      }
+      return b;
+    }
+  }
+  return 0;
+}
+
+// Add a page of buffers to the free queue.
+// Caller must hold bcache.lock. Returns 0 if out of memory.
+static int
+grow(void)
+{
+  struct bslab *s;
+  struct buf *b;
+
+  if((s = (struct bslab*)kalloc()) == 0)
+    return 0;
+  memset(s, 0, PGSIZE);
+  for(b = s->buf; b < s->buf + BUFPERSLAB; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->bucket = -1;
+    qpush(QFREE, b);
+  }
+  s->next = bcache.slabs;
+  bcache.slabs = s;
+  bcache.nbuf += BUFPERSLAB;
+  bcache.grows++;
+  return 1;
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct bucket *bk;
+  int n;
 
   initlock(&bcache.lock, "bcache");
+  initsleeplock(&bcache.statlock, "bcache.stat");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
+  bcache.twoq = 1;
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // start with 1/32 of free memory, and let the cache grow to
+  // 1/8 while at least 1/4 of memory is free.
+  n = kfreecount();
+  bcache.lowfree = n / 4;
+  bcache.maxbuf = n / 8 * BUFPERSLAB;
+  if(bcache.maxbuf < NBUF)
+    bcache.maxbuf = NBUF;
+  while(bcache.nbuf < NBUF || bcache.nbuf < n / 32 * BUFPERSLAB)
+    if(grow() == 0)
+      panic("binit");
+}
+
+// Take b, an unused buffer, out of the cache. Caller must hold
+// bcache.lock. Returns 0 if b got a reference in the meantime.
+static int
+evict(struct buf *b)
+{
+  struct bucket *bk;
+
+  if(b->bucket >= 0){
+    bk = &bcache.bucket[b->bucket];
+    acquire(&bk->lock);
+    if(b->refcnt != 0){
+      release(&bk->lock);
+      return 0;
+    }
+    unhash(bk, b);
+    release(&bk->lock);
   }
+  if(b->readahead){
+    b->readahead = 0;
+    bcache.rawasted++;
+  }
+  if(b->queue == QA1 && b->valid){
+    int g = ghosthash(b->dev, b->blockno);
+    bcache.ghost[g].dev = b->dev;
+    bcache.ghost[g].blockno = b->blockno;
+  }
+  qremove(b);
+  return 1;
+}
+
+// Find a buffer to recycle and take it out of the cache.
+// Caller must hold bcache.lock.
+static struct buf*
+victim(void)
+{
+  struct buf *b, *next;
+  int i, n;
+
+  if((b = bcache.q[QFREE].tail) != 0){
+    qremove(b);
+    return b;
+  }
+
+  // A1 first, while it holds more than its share.
+  if(bcache.q[QA1].n > bcache.nbuf / 4 || bcache.q[QAM].n == 0){
+    for(b = bcache.q[QA1].tail; b; b = b->prev)
+      if(b->refcnt == 0 && evict(b))
+        return b;
+  }
+
+  // CLOCK over Am: a referenced buffer goes back to the head
+  // with its bit cleared. Two rounds clear every bit.
+  n = 2 * bcache.q[QAM].n;
+  for(i = 0, b = bcache.q[QAM].tail; i < n && b; i++, b = next){
+    next = b->prev;
+    if(b->ref){
+      b->ref = 0;
+      qremove(b);
+      qpush(QAM, b);
+      if(next == 0)
+        next = bcache.q[QAM].tail;
+    } else if(b->refcnt == 0 && evict(b)){
+      return b;
+    }
+  }
+
+  for(b = bcache.q[QA1].tail; b; b = b->prev)
+    if(b->refcnt == 0 && evict(b))
+      return b;
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -58,34 +318,117 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *bk = hash(dev, blockno);
   struct buf *b;
+  int g;
 
-  acquire(&bcache.lock);
+  acquire(&bk->lock);
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  if((b = lookup(bk, dev, blockno)) != 0){
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  // Not cached. Only misses add blocks to the cache, and they
+  // hold bcache.lock, so look again once we have it.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = lookup(bk, dev, blockno)) != 0){
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
+  }
+  release(&bk->lock);
+
+  bcache.misses++;
+  if(bcache.q[QFREE].n == 0 && bcache.nbuf + BUFPERSLAB <= bcache.maxbuf &&
+     kfreecount() > bcache.lowfree)
+    grow();
+  // every buffer in use: go over maxbuf rather than give up.
+  if((b = victim()) == 0 && (grow() == 0 || (b = victim()) == 0))
+    panic("bget: no buffers");
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  b->ref = 0;
+  g = ghosthash(dev, blockno);
+  if(!bcache.twoq){
+    qpush(QAM, b);
+  } else if(bcache.ghost[g].dev == dev && bcache.ghost[g].blockno == blockno){
+    bcache.ghost[g].dev = 0;
+    bcache.ghosthits++;
+    qpush(QAM, b);
+  } else {
+    qpush(QA1, b);
+  }
+
+  acquire(&bk->lock);
+  b->bucket = bk - bcache.bucket;
+  b->hnext = bk->chain;
+  bk->chain = b;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Free up to npage pages of buffers that are all unused, while
+// more than min buffers remain. Caller must hold bcache.lock.
+static int
+shrink(int npage, int min)
+{
+  struct bslab *s, **sp;
+  struct buf *b;
+  int n = 0, busy;
+
+  sp = &bcache.slabs;
+  while((s = *sp) != 0 && n < npage && bcache.nbuf - BUFPERSLAB >= min){
+    // evict what can be evicted; the buffers go on the free
+    // queue, so they are not lost if the page has to stay.
+    busy = 0;
+    for(b = s->buf; b < s->buf + BUFPERSLAB; b++){
+      if(b->queue == QFREE)
+        continue;
+      if(b->refcnt == 0 && evict(b)){
+        b->valid = 0;
+        qpush(QFREE, b);
+      } else {
+        busy = 1;
+      }
+    }
+    if(busy){
+      sp = &s->next;
+      continue;
     }
+    for(b = s->buf; b < s->buf + BUFPERSLAB; b++)
+      qremove(b);
+    *sp = s->next;
+    bcache.nbuf -= BUFPERSLAB;
+    bcache.shrinks++;
+    kfree(s);
+    n++;
   }
-  panic("bget: no buffers");
+  return n;
+}
+
+// Give pages of unused buffers back to the allocator, for
+// kallocreclaim(), keeping at least NBUF buffers.
+// Returns the number of pages freed.
+int
+bshrink(void)
+{
+  int n;
+
+  acquire(&bcache.lock);
+  n = shrink(BSHRINK, NBUF);
+  release(&bcache.lock);
+  return n;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,58 +439,201 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    iorw(b, 0);
     b->valid = 1;
   }
   return b;
 }
 
+// Start reading the indicated block into the cache, unless it
+// is there already, and return without waiting for it.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct bucket *bk = hash(dev, blockno);
+  struct buf *b;
+
+  acquire(&bk->lock);
+  for(b = bk->chain; b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  release(&bk->lock);
+  if(b)
+    return;
+
+  b = bget(dev, blockno);
+  if(b->valid){
+    brelse(b);
+    return;
+  }
+  b->readahead = 1;
+  b->done = bdone;
+  iostart(b, 0);
+  acquire(&bk->lock);
+  bk->rastarts++;
+  release(&bk->lock);
+}
+
+// Called by iodone() when a read started by
+// breadahead() has finished: the data is valid, and the
+// read-ahead lets go of the buffer.
+void
+bdone(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[b->bucket];
+
+  b->valid = 1;
+  b->done = 0;
+  releasesleep(&b->lock);
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  iorw(b, 1);
+}
+
+// Start writing b's contents to disk, and return without waiting.
+// Must be locked, and stay locked until bwait(b) returns, so
+// that many writes can be in flight at once.
+void
+bwritestart(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwritestart");
+  iostart(b, 1);
+}
+
+// Start writing the n bufs in b, like bwritestart() on each,
+// but queued together, so that runs of consecutive blocks go to
+// the disk as single requests. The caller waits for each buf
+// with bwait().
+void
+bwritestartv(struct buf **b, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(!holdingsleep(&b[i]->lock))
+      panic("bwritestartv");
+  iostartv(b, n, 1);
+}
+
+// Wait for the write bwritestart() started on b to finish.
+void
+bwait(struct buf *b)
+{
+  iowait(b);
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Mark it referenced, for the CLOCK over the Am queue.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  // b can't leave its bucket while it has a reference.
+  bk = &bcache.bucket[b->bucket];
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  b->ref = 1;
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[b->bucket];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[b->bucket];
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
+// Copy out the cache's statistics to addr. If maxbuf is
+// positive, make it the cache's size limit, shrinking the cache
+// if it is larger; if twoq is 0 or 1, turn 2Q off or on; if
+// ramax is not negative, make it readi()'s largest read-ahead
+// window, in blocks (0 turns read-ahead off); if maxseg is
+// positive, make it the most blocks the disk scheduler puts in
+// one request.
+uint64
+sys_bcachestat(void)
+{
+  uint64 addr;
+  int maxbuf, twoq, ramax, maxseg, i;
+  struct bcachestat *st = &bcache.st;
+  struct bucket *bk;
 
+  argaddr(0, &addr);
+  argint(1, &maxbuf);
+  argint(2, &twoq);
+  argint(3, &ramax);
+  argint(4, &maxseg);
+  if(ramax >= 0)
+    readaheadmax = ramax;
+  acquiresleep(&bcache.statlock);
+  memset(st, 0, sizeof(*st));
+  acquire(&bcache.lock);
+  if(maxbuf > 0){
+    bcache.maxbuf = maxbuf < NBUF ? NBUF : maxbuf;
+    if(bcache.nbuf > bcache.maxbuf)
+      shrink((bcache.nbuf - bcache.maxbuf + BUFPERSLAB - 1) / BUFPERSLAB,
+             bcache.maxbuf);
+  }
+  if(twoq == 0 || twoq == 1)
+    bcache.twoq = twoq;
+  if(maxseg > 0)
+    iomaxseg = maxseg < MAXSEG ? maxseg : MAXSEG;
+  st->nbuf = bcache.nbuf;
+  st->maxbuf = bcache.maxbuf;
+  st->nbucket = NBUCKET;
+  st->ramax = readaheadmax;
+  st->twoq = bcache.twoq;
+  st->maxseg = iomaxseg;
+  st->na1 = bcache.q[QA1].n;
+  st->nam = bcache.q[QAM].n;
+  st->misses = bcache.misses;
+  st->ghosthits = bcache.ghosthits;
+  st->grows = bcache.grows;
+  st->shrinks = bcache.shrinks;
+  st->rawasted = bcache.rawasted;
+  st->nacquire[NBUCKET] = bcache.lock.n;
+  st->ncontend[NBUCKET] = bcache.lock.nts;
+  release(&bcache.lock);
+  for(i = 0; i < NBUCKET; i++){
+    bk = &bcache.bucket[i];
+    acquire(&bk->lock);
+    // the counts include this acquire.
+    st->nacquire[i] = bk->lock.n;
+    st->ncontend[i] = bk->lock.nts;
+    st->hits += bk->hits;
+    st->rastarts += bk->rastarts;
+    st->rahits += bk->rahits;
+    release(&bk->lock);
+  }
+  virtio_disk_stat(&st->nreq, &st->nreqblocks);
+  i = copyout(myproc()->pagetable, addr, (char *)st, sizeof(*st));
+  releasesleep(&bcache.statlock);
+  return i < 0 ? -1 : 0;
+}
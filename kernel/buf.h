@@ -1,11 +1,21 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  void (*done)(struct buf*); // if set, iodone() calls it
+  int write;        // queued for writing, not reading
+  int qprio;        // priority of the process that queued it
+  uint64 qtime;     // r_time() when it was queued
+  struct buf *qnext; // iosched queue
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  int bucket;       // hash bucket holding the buf, or -1
+  struct buf *hnext; // hash chain
+  int queue;        // replacement queue the buf is on
+  int ref;          // released since the CLOCK hand last passed
+  int readahead;    // read ahead, and not used since
+  struct buf *prev; // replacement queue
   struct buf *next;
   uchar data[BSIZE];
 };
@@ -4,15 +4,26 @@ typedef long int off_t;
 #endif
 struct buf;
 struct context;
+struct execseg;
 struct file;
 struct inode;
+struct meminfo;
 struct pipe;
 struct proc;
+struct procmem;
 struct spinlock;
 struct sleeplock;
+struct shm;
 struct stat;
+struct vma;
 struct superblock;
 
+// asid.c
+void            asidinit(void);
+void            asidreset(struct proc*);
+void            tlbstale(pagetable_t);
+uint64          asidsatp(struct proc*, int*);
+
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
@@ -20,6 +31,21 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(void);
+void            breadahead(uint, uint);
+void            bdone(struct buf*);
+void            bwritestart(struct buf*);
+void            bwait(struct buf*);
+void            bwritestartv(struct buf**, int);
+
+// iosched.c
+void            iosinit(void);
+void            iostart(struct buf*, int);
+void            iostartv(struct buf**, int, int);
+void            iowait(struct buf*);
+void            iorw(struct buf*, int);
+void            iodone(struct buf**, int);
+int             iosetdepth(int);
 
 // console.c
 void            consoleinit(void);
@@ -28,6 +54,8 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+struct execseg* execseg(struct proc*, uint64);
+uint64          execload(pagetable_t, struct inode*, struct execseg*, uint64, int);
 
 // file.c
 struct file*    filealloc(void);
@@ -44,6 +72,10 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+int             iexecget(struct inode*);
+void            iexecput(struct inode*);
+int             iwriteget(struct inode*);
+void            iwriteput(struct inode*);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -54,6 +86,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             readipage(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -65,15 +98,37 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kallocpool(int);
 void            kfree(void *);
+void            kfreevec(void **, int);
 void            kinit(void);
+void            krefinc(void *);
+int             krefcnt(void *);
+uint64          kfreecount(void);
+void            kmeminfo(struct meminfo*);
+
+// ksm.c
+void            ksminit(void);
+uint64          zeropage(void);
+char*           ksmmerge(char*);
+int             ksmflush(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
+void            begin_opn(int);
+int             log_writeblocks(int);
+int             log_maxwrite(void);
 void            end_op(void);
 
+// mmap.c
+struct vma*     vmalookup(struct proc*, uint64);
+uint64          vmafault(pagetable_t, struct vma*, uint64, int);
+void            fpinit(void);
+int             vmacopy(struct proc*, struct proc*);
+void            vmafreeall(struct proc*);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -104,12 +159,14 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(void (*)(void), char*);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             procmeminfo(uint64, int);
 void            backtrace(void);
 void schedule(void);          // 新的一段式调度入口
 void prio_on_tick(void);      // 时钟中断里用到
@@ -129,6 +186,11 @@ int             atomic_read4(int *addr);
 void            freelock(struct spinlock*);
 #endif
 
+// shm.c
+int             shmalloc(struct file**, uint64);
+uint64          shmpage(struct shm*, uint64);
+void            shmclose(struct shm*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -144,6 +206,14 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(void);
+int             reclaim(void);
+void*           kallocreclaim(void);
+uint64          swapin(pagetable_t, uint64, int);
+void            swapdup(pte_t);
+void            swapunmap(pte_t);
+
 // syscall.c
 void            argint(int, int*);
 int             argstr(int, char*, int);
@@ -170,15 +240,23 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+void            vmsummary(char*, pagetable_t);
+void            uvmstat(struct proc*, struct procmem*);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
+int             cowfault(pagetable_t, uint64);
+uint64          vmfault(pagetable_t, uint64, int);
+uint64          uvmpin(uint64, uint64, int);
+void            uvmunpin(void);
 void            uvmfree(pagetable_t, uint64);
+void            ptcachefree(struct proc*);
+void            uvmmovetop(pagetable_t, pagetable_t);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
-void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
@@ -199,8 +277,11 @@ void            plic_complete(int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_startv(struct buf **, int, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_poll(void);
+void            virtio_disk_nointr(int);
+void            virtio_disk_stat(uint64*, uint64*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -5,10 +5,11 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "elf.h"
 
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
-
 int flags2perm(int flags)
 {
     int perm = 0;
@@ -26,8 +27,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *oldip;
   struct proghdr ph;
+  struct execseg segs[NEXECSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -38,6 +41,12 @@ exec(char *path, char **argv)
     return -1;
   }
   ilock(ip);
+  // the program is paged in from ip, which mustn't change.
+  if(iexecget(ip) < 0){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
 
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -46,10 +55,13 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pagetable = proc_pagetable(p)) == 0)
+  // the trampoline, trapframe and usyscall mappings are moved
+  // over from the old page table when exec commits.
+  if((pagetable = uvmcreate()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments. Nothing is read or mapped
+  // here: vmfault() pages each one in from ip on first touch.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -61,31 +73,33 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.vaddr < sz || ph.vaddr + ph.memsz > HEAPTOP)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg >= NEXECSEG)
       goto bad;
+    segs[nseg].va = ph.vaddr;
+    segs[nseg].memsz = ph.memsz;
+    segs[nseg].filesz = ph.filesz;
+    segs[nseg].off = ph.off;
+    segs[nseg].perm = flags2perm(ph.flags);
+    nseg++;
+    sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // keep a reference to ip for paging the program in.
+  iunlock(ip);
   end_op();
-  ip = 0;
 
   p = myproc();
   uint64 oldsz = p->sz;
 
-  // Allocate some pages at the next page boundary.
-  // Make the first inaccessible as a stack guard.
-  // Use the rest as the user stack.
+  // The heap starts at the next page boundary. Map the top
+  // USERSTACK pages of the stack, for the arguments; the rest
+  // of the stack is faulted in as it grows (see vmfault()).
   sz = PGROUNDUP(sz);
-  uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, sz, sz + (USERSTACK+1)*PGSIZE, PTE_W)) == 0)
-    goto bad;
-  sz = sz1;
-  uvmclear(pagetable, sz-(USERSTACK+1)*PGSIZE);
-  sp = sz;
+  sp = USTACKTOP;
   stackbase = sp - USERSTACK*PGSIZE;
+  if(uvmalloc(pagetable, stackbase, sp, PTE_W) == 0)
+    goto bad;
 
   // Push argument strings, prepare rest of stack in ustack.
   for(argc = 0; argv[argc]; argc++) {
@@ -121,12 +135,27 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  vmafreeall(p);
   oldpagetable = p->pagetable;
+  uvmmovetop(oldpagetable, pagetable);
+  oldip = p->execip;
   p->pagetable = pagetable;
+  asidreset(p);
+  p->wc.l0 = 0;
   p->sz = sz;
+  p->stackbase = stackbase;
+  p->execip = ip;
+  memmove(p->execseg, segs, sizeof(segs));
+  p->nexecseg = nseg;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldip){
+    iexecput(oldip);
+    begin_op();
+    iput(oldip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -134,33 +163,77 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
-    end_op();
+    iexecput(ip);
+    if(holdingsleep(&ip->lock)){
+      iunlockput(ip);
+      end_op();
+    } else {
+      begin_op();
+      iput(ip);
+      end_op();
+    }
   }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// Return the program segment of p that contains va, or 0.
+struct execseg*
+execseg(struct proc *p, uint64 va)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
+  struct execseg *s;
+
+  for(s = p->execseg; s < &p->execseg[p->nexecseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      return s;
   return 0;
 }
+
+// Page in the page at va of program segment s: allocate a page,
+// read the part of it backed by the file from ip, leave the rest
+// zero, and map it into pagetable with the segment's permissions.
+// A read of a page with nothing from the file maps the zero page,
+// and read-only text is shared with identical pages (see ksm.c).
+// read is 0 for a store.
+// Returns the physical address, or 0 on failure.
+uint64
+execload(pagetable_t pagetable, struct inode *ip, struct execseg *s, uint64 va, int read)
+{
+  char *mem;
+  uint64 off, pa;
+  uint n = 0;
+  int perm;
+
+  va = PGROUNDDOWN(va);
+  off = va - s->va;
+  if(read && off >= s->filesz){
+    perm = s->perm|PTE_R|PTE_U;
+    if(perm & PTE_W)
+      perm = (perm & ~PTE_W) | PTE_COW;
+    pa = zeropage();
+    if(mappages(pagetable, va, PGSIZE, pa, perm) != 0){
+      kfree((void*)pa);
+      return 0;
+    }
+    return pa;
+  }
+
+  if((mem = kallocreclaim()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+
+  if(off < s->filesz){
+    n = s->filesz - off < PGSIZE ? s->filesz - off : PGSIZE;
+    if(readipage(ip, mem, s->off + off, n) != n){
+      kfree(mem);
+      return 0;
+    }
+  }
+  if((s->perm & PTE_W) == 0)
+    mem = ksmmerge(mem);
+
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, s->perm|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return 0;
+  }
+  return (uint64)mem;
+}
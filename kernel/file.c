@@ -75,7 +75,11 @@ fileclose(struct file *f)
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
+  } else if(ff.type == FD_SHM){
+    shmclose(ff.shm);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
+    if(ff.type == FD_INODE && ff.writable)
+      iwriteput(ff.ip);
     begin_op();
     iput(ff.ip);
     end_op();
@@ -118,10 +122,23 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    // fault in the part of the buffer the read will fill
+    // before locking the inode (see uvmpin()).
+    ilock(f->ip);
+    if(n > 0 && f->off + n > f->ip->size)
+      n = f->off < f->ip->size ? f->ip->size - f->off : 0;
+    iunlock(f->ip);
+    if(n > 0 && (n = uvmpin(addr, n, 1)) == 0){
+      uvmunpin();
+      return -1;
+    }
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+    uvmunpin();
+  } else if(f->type == FD_SHM){
+    return -1;   // use mmap()
   } else {
     panic("fileread");
   }
@@ -146,25 +163,32 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // write as many blocks at a time as fit in a log
+    // transaction, including i-node, indirect block,
+    // allocation blocks, and 2 blocks of slop for
+    // non-aligned writes (see log_writeblocks()).
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    int max = log_maxwrite();
     int i = 0;
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
         n1 = max;
 
-      begin_op();
+      // fault in the source before locking the inode
+      // (see uvmpin()).
+      if((n1 = uvmpin(addr + i, n1, 0)) == 0){
+        uvmunpin();
+        break;
+      }
+      begin_opn(log_writeblocks(n1));
       ilock(f->ip);
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
       end_op();
+      uvmunpin();
 
       if(r != n1){
         // error from writei
@@ -173,6 +197,8 @@ filewrite(struct file *f, uint64 addr, int n)
       i += r;
     }
     ret = (i == n ? n : -1);
+  } else if(f->type == FD_SHM){
+    return -1;   // use mmap()
   } else {
     panic("filewrite");
   }
@@ -1,10 +1,11 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SHM } type;
   int ref; // reference count
   char readable;
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
+  struct shm *shm;   // FD_SHM
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
 };
@@ -18,6 +19,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // processes running it as their program
+  int nwrite;         // files open on it for writing
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -27,6 +30,11 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  // sequential read-ahead state; see readahead() in fs.c.
+  uint ranext;        // block after the one readi() read last
+  uint rawin;         // blocks to read ahead of it
+  uint raend;         // first block not yet read ahead
 };
 
 // map major device number to device functions.
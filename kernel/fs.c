@@ -24,7 +24,11 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
-struct superblock sb; 
+struct superblock sb;
+
+// Largest read-ahead window of readi(), in blocks; 0 for none.
+// bcachestat() changes it.
+int readaheadmax = RAMAX; 
 
 // Read the super block.
 static void
@@ -287,6 +291,61 @@ idup(struct inode *ip)
   return ip;
 }
 
+// ip becomes a process's program, which is paged in from it
+// (see execload()), so it must not change while that process
+// runs. Returns -1 if some file has ip open for writing.
+int
+iexecget(struct inode *ip)
+{
+  int r = 0;
+
+  acquire(&itable.lock);
+  if(ip->nwrite > 0)
+    r = -1;
+  else
+    ip->nexec++;
+  release(&itable.lock);
+  return r;
+}
+
+// A process has stopped running ip as its program.
+void
+iexecput(struct inode *ip)
+{
+  acquire(&itable.lock);
+  if(ip->nexec < 1)
+    panic("iexecput");
+  ip->nexec--;
+  release(&itable.lock);
+}
+
+// A file is being opened to write ip. Returns -1 if some
+// process is running ip as its program.
+int
+iwriteget(struct inode *ip)
+{
+  int r = 0;
+
+  acquire(&itable.lock);
+  if(ip->nexec > 0)
+    r = -1;
+  else
+    ip->nwrite++;
+  release(&itable.lock);
+  return r;
+}
+
+// A file open to write ip has been closed.
+void
+iwriteput(struct inode *ip)
+{
+  acquire(&itable.lock);
+  if(ip->nwrite < 1)
+    panic("iwriteput");
+  ip->nwrite--;
+  release(&itable.lock);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -310,6 +369,7 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->ranext = ip->rawin = ip->raend = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -464,6 +524,42 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// readi() is about to read block bn of ip. If ip is being read
+// sequentially, start reading the blocks after bn into the buffer
+// cache, without waiting for them. The window of blocks read
+// ahead doubles with each sequential block, up to readaheadmax,
+// and closes again when a read seeks elsewhere.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint bn)
+{
+  uint end, addr;
+
+  if(bn + 1 == ip->ranext)
+    return;   // another read in the same block
+  if(bn != ip->ranext){
+    ip->rawin = 0;
+  } else if(ip->rawin < readaheadmax){
+    ip->rawin = ip->rawin ? 2*ip->rawin : 2;
+  }
+  if(ip->rawin > readaheadmax)
+    ip->rawin = readaheadmax;
+  ip->ranext = bn + 1;
+
+  end = bn + 1 + ip->rawin;
+  if(end > (ip->size + BSIZE - 1) / BSIZE)
+    end = (ip->size + BSIZE - 1) / BSIZE;
+  if(ip->raend < bn + 1)
+    ip->raend = bn + 1;
+  for(; ip->raend < end; ip->raend++){
+    // blocks within the file's size are all allocated,
+    // so bmap() only looks them up.
+    if((addr = bmap(ip, ip->raend)) == 0)
+      break;
+    breadahead(ip->dev, addr);
+  }
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -483,6 +579,7 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
+    readahead(ip, off/BSIZE);
     bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
@@ -495,6 +592,22 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Read n bytes at offset off of ip into the kernel page dst,
+// to fill in a page on a page fault. The faulting process holds
+// no other inode lock: fileread() and filewrite() fault in user
+// buffers before locking the file (see uvmpin()).
+// Returns the number of bytes read, as readi() does.
+int
+readipage(struct inode *ip, char *dst, uint off, uint n)
+{
+  int r;
+
+  ilock(ip);
+  r = readi(ip, 0, (uint64)dst, off, n);
+  iunlock(ip);
+  return r;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
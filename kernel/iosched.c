@@ -0,0 +1,313 @@
+//
+// Disk request scheduler, between the buffer cache and the
+// virtio driver.
+//
+// iostart() queues a buf for reading or writing, and the
+// scheduler sends requests to the disk, at most ios.depth at a
+// time, so that the queue holds enough to choose from. When a
+// request finishes, iodone() sends the next. The policy decides
+// which queued buf goes next:
+//
+// * IOS_NOOP: the one queued first.
+// * IOS_DEADLINE: the next by block number after the last request,
+//   wrapping around to the lowest (C-SCAN), which cuts seeks;
+//   but the one queued first if it has waited longer than
+//   READEXPIRE or WRITEEXPIRE, so that nothing starves.
+// * IOS_PRIO: the one whose process had the best priority when it
+//   queued it, then by block number like IOS_DEADLINE, with the
+//   same expiry.
+//
+// Under every policy, queued bufs holding the blocks just before
+// or after the chosen one go in the same request, up to iomaxseg
+// blocks (see virtio_disk_startv()).
+//
+// Completions normally arrive by interrupt, after which iodone()
+// wakes the waiting process. If ios.poll is set, iowait() first
+// spins for up to that long, handing finished requests to
+// iodone() itself with virtio_disk_poll(), while the device is
+// asked not to interrupt; a short synchronous read then costs
+// neither an interrupt nor a sleep and wakeup.
+//
+// ios.lock is taken before disk.vdisk_lock; virtio_disk_intr()
+// lets go of vdisk_lock before it calls iodone().
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "iosched.h"
+
+#define READEXPIRE  50000    // 5 ms of the 10 MHz timer
+#define WRITEEXPIRE 500000   // 50 ms
+
+int iomaxseg = MAXSEG;   // most blocks in one request
+
+struct {
+  struct spinlock lock;
+  int policy;
+  int depth;
+  int inflight;
+  int queued;
+  struct buf *head;     // queued bufs, oldest first, through qnext
+  struct buf *tail;
+  uint next;            // block after the last request's
+  uint64 poll;          // r_time() cycles iowait() polls for, or 0
+  int npoll;            // processes polling
+  struct iostat st;
+} ios;
+
+void
+iosinit(void)
+{
+  initlock(&ios.lock, "iosched");
+  ios.policy = IOS_DEADLINE;
+  ios.depth = IODEPTH;
+}
+
+// How far the elevator has to go from ios.next to reach b,
+// wrapping around past the end of the disk.
+static uint
+distance(struct buf *b)
+{
+  return b->blockno - ios.next;
+}
+
+// Choose the queued buf to send next.
+static struct buf*
+choose(void)
+{
+  struct buf *b, *c;
+  uint64 expire;
+
+  c = ios.head;
+  if(ios.policy == IOS_NOOP)
+    return c;
+  expire = c->write ? WRITEEXPIRE : READEXPIRE;
+  if(r_time() - c->qtime > expire){
+    ios.st.nexpired[ios.policy]++;
+    return c;
+  }
+  for(b = c->qnext; b; b = b->qnext){
+    if(ios.policy == IOS_PRIO && b->qprio != c->qprio){
+      if(b->qprio < c->qprio)
+        c = b;
+    } else if(distance(b) < distance(c)){
+      c = b;
+    }
+  }
+  return c;
+}
+
+// Find a queued buf that could go in a request with b, holding
+// block blockno.
+static struct buf*
+neighbor(struct buf *b, uint blockno)
+{
+  struct buf *x;
+
+  for(x = ios.head; x; x = x->qnext)
+    if(x->blockno == blockno && x->dev == b->dev && x->write == b->write)
+      return x;
+  return 0;
+}
+
+static void
+unqueue(struct buf *b)
+{
+  struct buf **pp, *prev = 0;
+
+  for(pp = &ios.head; *pp != b; pp = &(*pp)->qnext)
+    prev = *pp;
+  *pp = b->qnext;
+  if(ios.tail == b)
+    ios.tail = prev;
+  ios.queued--;
+}
+
+// Send queued bufs to the disk while there is room.
+// Caller holds ios.lock.
+static void
+dispatch(void)
+{
+  struct buf *b[MAXSEG], *x;
+  int i, n, max = iomaxseg;
+
+  while(ios.head && ios.inflight < ios.depth){
+    b[0] = choose();
+    n = 1;
+    while(n < max && (x = neighbor(b[0], b[0]->blockno - 1))){
+      for(i = n; i > 0; i--)
+        b[i] = b[i-1];
+      b[0] = x;
+      n++;
+    }
+    while(n < max && (x = neighbor(b[0], b[n-1]->blockno + 1)))
+      b[n++] = x;
+    // the ring can be full if requests are large; a request
+    // that finishes will call dispatch() again.
+    if(virtio_disk_startv(b, n, b[0]->write) < 0)
+      break;
+    for(i = 0; i < n; i++)
+      unqueue(b[i]);
+    ios.inflight++;
+    ios.next = b[n-1]->blockno + 1;
+    ios.st.nreq[ios.policy]++;
+    ios.st.nblocks[ios.policy] += n;
+  }
+}
+
+// Queue the n bufs in b to be read or written, and return without
+// waiting for the disk. When the disk is done with a buf, iodone()
+// clears b->disk and calls b->done(b) if it is set, or else wakes
+// up iowait(b).
+void
+iostartv(struct buf **b, int n, int write)
+{
+  int i;
+
+  acquire(&ios.lock);
+  for(i = 0; i < n; i++){
+    b[i]->disk = 1;
+    b[i]->write = write;
+    b[i]->qprio = myproc()->prio;
+    b[i]->qtime = r_time();
+    b[i]->qnext = 0;
+    if(ios.tail)
+      ios.tail->qnext = b[i];
+    else
+      ios.head = b[i];
+    ios.tail = b[i];
+    ios.queued++;
+  }
+  dispatch();
+  release(&ios.lock);
+}
+
+void
+iostart(struct buf *b, int write)
+{
+  iostartv(&b, 1, write);
+}
+
+// Wait for the read or write iostart() queued on b, which must
+// not have a b->done, to finish.
+void
+iowait(struct buf *b)
+{
+  uint64 start, poll = ios.poll;
+
+  if(poll && b->disk){
+    acquire(&ios.lock);
+    if(ios.npoll++ == 0)
+      virtio_disk_nointr(1);
+    release(&ios.lock);
+    start = r_time();
+    while(b->disk && r_time() - start < poll)
+      virtio_disk_poll();
+    acquire(&ios.lock);
+    if(--ios.npoll == 0)
+      virtio_disk_nointr(0);
+    if(b->disk == 0)
+      ios.st.npolled++;
+    release(&ios.lock);
+    // a request may have finished while interrupts were off.
+    virtio_disk_poll();
+  }
+
+  acquire(&ios.lock);
+  if(b->disk)
+    ios.st.nslept++;
+  while(b->disk == 1)
+    sleep(b, &ios.lock);
+  release(&ios.lock);
+}
+
+void
+iorw(struct buf *b, int write)
+{
+  iostart(b, write);
+  iowait(b);
+}
+
+// Called by virtio_disk_intr() when the disk has finished a
+// request for the n bufs in b.
+void
+iodone(struct buf **b, int n)
+{
+  uint64 us;
+  int i, h;
+
+  acquire(&ios.lock);
+  for(i = 0; i < n; i++){
+    us = (r_time() - b[i]->qtime) / 10;
+    for(h = 0; h < NIOHIST-1 && us >= (1L << h); h++)
+      ;
+    ios.st.hist[ios.policy][b[i]->write][h]++;
+    b[i]->disk = 0;   // disk is done with buf
+    if(b[i]->done)
+      b[i]->done(b[i]);
+    else
+      wakeup(b[i]);
+  }
+  ios.inflight--;
+  dispatch();
+  release(&ios.lock);
+}
+
+// Set the most requests on the disk at once, and return the old
+// limit; for diskbench().
+int
+iosetdepth(int depth)
+{
+  int old;
+
+  acquire(&ios.lock);
+  old = ios.depth;
+  ios.depth = depth;
+  dispatch();
+  release(&ios.lock);
+  return old;
+}
+
+// Copy out the scheduler's statistics to addr. If policy is
+// one of the IOS_ values, switch to it; if depth is positive,
+// let that many requests be on the disk at once; if poll is not
+// negative, make iowait() poll for that many microseconds before
+// it sleeps (0 turns polling off).
+uint64
+sys_iosched(void)
+{
+  uint64 addr;
+  int policy, depth, poll;
+  struct iostat st;
+
+  argaddr(0, &addr);
+  argint(1, &policy);
+  argint(2, &depth);
+  argint(3, &poll);
+  acquire(&ios.lock);
+  if(policy >= 0 && policy < NIOPOLICY)
+    ios.policy = policy;
+  if(depth > 0)
+    ios.depth = depth;
+  if(poll >= 0)
+    ios.poll = poll * 10;
+  dispatch();
+  st = ios.st;
+  st.policy = ios.policy;
+  st.depth = ios.depth;
+  st.queued = ios.queued;
+  st.inflight = ios.inflight;
+  st.poll = ios.poll / 10;
+  release(&ios.lock);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
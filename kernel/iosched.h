@@ -0,0 +1,25 @@
+// Disk scheduling policies for iosched().
+#define IOS_NOOP     0   // arrival order
+#define IOS_DEADLINE 1   // elevator order, oldest first once it expires
+#define IOS_PRIO     2   // issuing process's priority, then elevator order
+#define NIOPOLICY    3
+
+#define NIOHIST      20  // latency histogram buckets
+
+// Disk scheduler statistics, returned by the iosched() system call.
+// hist[p][w][i] counts reads (w 0) or writes (w 1) under policy p
+// that took less than 2^i microseconds, from being queued to being
+// done, but not less than 2^(i-1); the last bucket has the rest.
+struct iostat {
+  int policy;
+  int depth;                        // most requests on the disk at once
+  int queued;                       // blocks waiting to go to the disk
+  int inflight;                     // requests on the disk
+  int poll;                         // microseconds iowait() polls for
+  uint64 npolled;                   // iowait()s that polling ended
+  uint64 nslept;                    // iowait()s that had to sleep
+  uint64 nreq[NIOPOLICY];           // requests sent to the disk
+  uint64 nblocks[NIOPOLICY];        //   and the blocks they carried
+  uint64 nexpired[NIOPOLICY];       // requests sent early as expired
+  uint64 hist[NIOPOLICY][2][NIOHIST];
+};
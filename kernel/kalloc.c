@@ -1,13 +1,27 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Free pages are kept on NCOLOR lists by cache color, the
+// physical page number modulo NCOLOR: pages of different colors
+// never compete for the same sets of a physically indexed cache.
+// kalloc() prefers the color of the page freed last, so that it
+// behaves much like a single LIFO list and tends to return a page
+// that is still in the cache. kallocpool() is for kernel objects
+// that are used on every trap or page walk (page-table pages,
+// trapframes, kernel stacks): each pool hands out successive
+// colors, so that the objects of one process, and those of
+// processes created one after another, don't evict each other.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
+#include "meminfo.h"
+#include "kpool.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -18,16 +32,47 @@ struct run {
   struct run *next;
 };
 
+#define PA2COLOR(pa) ((((uint64)(pa)) >> PGSHIFT) % NCOLOR)
+
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run *freelist[NCOLOR];
+  int hot;               // color of the page freed last
+  int on;                // kallocpool() colors its pages
+  int cursor[NKPOOL];    // next color for each pool
+  uint64 npages;         // pages freerange() handed to kfree()
+  uint64 nfree;          // pages on the free lists
+  uint64 ncolor[NCOLOR]; // pages on each free list
+  uint64 nalloc[NCPU];   // kalloc()s by each hart
+  uint64 nfreed[NCPU];   // pages put on freelist by each hart
+  uint64 allocs[NKPOOL]; // kallocpool()s for each pool
+  uint64 misses[NKPOOL]; //   that got another color than the cursor's
 } kmem;
 
+// Reference counts for physical pages, so that copy-on-write
+// fork can share a page between several page tables.
+// kalloc() sets the count to one, krefinc() adds a reference,
+// and kfree() only puts the page back on the free list when
+// the last reference goes away.
+struct {
+  struct spinlock lock;
+  int cnt[(PHYSTOP - KERNBASE) / PGSIZE];
+} kref;
+
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&kref.lock, "kref");
+  kmem.on = 1;
+  // start the pools' cursors apart.
+  for(int i = 0; i < NKPOOL; i++)
+    kmem.cursor[i] = i * NCOLOR / NKPOOL;
   freerange(end, (void*)PHYSTOP);
+  // the pages freerange() freed don't count as frees.
+  memset(kmem.nfreed, 0, sizeof(kmem.nfreed));
 }
 
 void
@@ -35,33 +80,99 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kref.cnt[PA2REF(p)] = 1;
+    kmem.npages++;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
+// Drop a reference to the page of physical memory pointed at by pa,
+// and free it if that was the last one. The page normally should
+// have been returned by a call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
 void
 kfree(void *pa)
+{
+  kfreevec(&pa, 1);
+}
+
+// kfree() each of the n pages in pa[], taking the allocator's
+// locks once for the lot. Overwrites pa[].
+void
+kfreevec(void **pa, int n)
 {
   struct run *r;
+  int i, m, c;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
-    panic("kfree");
+  for(i = 0; i < n; i++)
+    if(((uint64)pa[i] % PGSIZE) != 0 || (char*)pa[i] < end ||
+       (uint64)pa[i] >= PHYSTOP)
+      panic("kfree");
 
-  // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  // keep the pages whose last reference this was.
+  m = 0;
+  acquire(&kref.lock);
+  for(i = 0; i < n; i++){
+    if(kref.cnt[PA2REF(pa[i])] < 1)
+      panic("kfree: ref");
+    if(--kref.cnt[PA2REF(pa[i])] == 0)
+      pa[m++] = pa[i];
+  }
+  release(&kref.lock);
+  if(m == 0)
+    return;
 
-  r = (struct run*)pa;
+  // Fill with junk to catch dangling refs.
+  for(i = 0; i < m; i++)
+    memset(pa[i], 1, PGSIZE);
 
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  for(i = 0; i < m; i++){
+    r = (struct run*)pa[i];
+    c = PA2COLOR(r);
+    r->next = kmem.freelist[c];
+    kmem.freelist[c] = r;
+    kmem.hot = c;
+    kmem.ncolor[c]++;
+  }
+  kmem.nfree += m;
+  kmem.nfreed[cpuid()] += m;
   release(&kmem.lock);
 }
 
+// Take a page off the free list of color c, or if that is
+// empty, of the next color that has a free page.
+// Caller must hold kmem.lock.
+static struct run*
+takefree(int c)
+{
+  struct run *r;
+  int i, k;
+
+  for(i = 0; i < NCOLOR; i++){
+    k = (c + i) % NCOLOR;
+    if((r = kmem.freelist[k]) != 0){
+      kmem.freelist[k] = r->next;
+      kmem.nfree--;
+      kmem.ncolor[k]--;
+      kmem.nalloc[cpuid()]++;
+      return r;
+    }
+  }
+  return 0;
+}
+
+static void*
+newpage(struct run *r)
+{
+  if(r){
+    memset((char*)r, 5, PGSIZE); // fill with junk
+    kref.cnt[PA2REF(r)] = 1;
+  }
+  return (void*)r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -71,12 +182,108 @@ kalloc(void)
   struct run *r;
 
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = takefree(kmem.hot);
   release(&kmem.lock);
+  return newpage(r);
+}
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
-  return (void*)r;
+// Allocate a page for a kernel object of pool (see kpool.h),
+// of the pool's next color if there is one free.
+// Returns 0 if the memory cannot be allocated.
+void *
+kallocpool(int pool)
+{
+  struct run *r;
+  int c;
+
+  if(pool < 0 || pool >= NKPOOL)
+    panic("kallocpool");
+
+  acquire(&kmem.lock);
+  c = kmem.on ? kmem.cursor[pool] : kmem.hot;
+  r = takefree(c);
+  if(r){
+    kmem.allocs[pool]++;
+    if(PA2COLOR(r) != c)
+      kmem.misses[pool]++;
+    kmem.cursor[pool] = (PA2COLOR(r) + 1) % NCOLOR;
+  }
+  release(&kmem.lock);
+  return newpage(r);
+}
+
+// Add a reference to the page at pa, which must
+// already be allocated.
+void
+krefinc(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("krefinc");
+
+  acquire(&kref.lock);
+  if(kref.cnt[PA2REF(pa)] < 1)
+    panic("krefinc: free page");
+  kref.cnt[PA2REF(pa)]++;
+  release(&kref.lock);
+}
+
+// Return the number of pages on the free list.
+uint64
+kfreecount(void)
+{
+  uint64 n;
+
+  acquire(&kmem.lock);
+  n = kmem.nfree;
+  release(&kmem.lock);
+  return n;
+}
+
+// Fill in the allocator's part of a meminfo() result.
+void
+kmeminfo(struct meminfo *mi)
+{
+  acquire(&kmem.lock);
+  mi->npages = kmem.npages;
+  mi->nfree = kmem.nfree;
+  memmove(mi->nalloc, kmem.nalloc, sizeof(mi->nalloc));
+  memmove(mi->nfreed, kmem.nfreed, sizeof(mi->nfreed));
+  release(&kmem.lock);
+}
+
+// Return the number of references to the page at pa.
+int
+krefcnt(void *pa)
+{
+  int n;
+
+  acquire(&kref.lock);
+  n = kref.cnt[PA2REF(pa)];
+  release(&kref.lock);
+  return n;
+}
+
+// Copy out the allocator's statistics to addr, and if on is 0
+// or 1, turn kallocpool()'s coloring off or on.
+uint64
+sys_kpoolstat(void)
+{
+  uint64 addr;
+  int on;
+  struct kpoolstat st;
+
+  argaddr(0, &addr);
+  argint(1, &on);
+  acquire(&kmem.lock);
+  if(on == 0 || on == 1)
+    kmem.on = on;
+  st.ncolor = NCOLOR;
+  st.on = kmem.on;
+  memmove(st.allocs, kmem.allocs, sizeof(st.allocs));
+  memmove(st.misses, kmem.misses, sizeof(st.misses));
+  memmove(st.nfree, kmem.ncolor, sizeof(st.nfree));
+  release(&kmem.lock);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
 }
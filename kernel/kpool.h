@@ -0,0 +1,15 @@
+// Pools of kernel-object pages for kallocpool(). Each pool
+// hands out pages of successive cache colors.
+#define KPOOL_PGTBL     0   // page-table pages
+#define KPOOL_TRAPFRAME 1   // trapframes and usyscall pages
+#define KPOOL_KSTACK    2   // kernel stacks
+#define NKPOOL          3
+
+// Allocator statistics, returned by the kpoolstat() system call.
+struct kpoolstat {
+  int ncolor;             // page colors
+  int on;                 // kallocpool() colors its pages
+  uint64 allocs[NKPOOL];  // kallocpool() calls for each pool
+  uint64 misses[NKPOOL];  //   that didn't get the color they wanted
+  uint64 nfree[NCOLOR];   // free pages of each color
+};
@@ -0,0 +1,148 @@
+//
+// Sharing pages with identical contents.
+//
+// A single zero-filled page stands in for anonymous memory that
+// has been read but not written: vmfault() and execload() map it
+// copy-on-write, and uvmalloc() maps it for each new page, so the
+// first store gets a private page from cowfault(). The zero page
+// holds a reference of its own, so cowfault() always copies it.
+//
+// Pages of read-only program text are looked up by contents in a
+// hash table when execload() reads them from the file. If an
+// identical page is already in the table, that page is mapped and
+// the new one is freed, so every process running a program (and
+// programs with pages in common) shares one copy of each text
+// page. The table holds a reference to each of its pages, which
+// ksmflush() gives up when memory runs out.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "ksm.h"
+
+#define NKSM 256   // text pages in the merge table
+
+struct {
+  struct spinlock lock;
+  char *zero;
+  struct {
+    uint64 hash;
+    char *pa;      // 0 if the entry is free
+  } tab[NKSM];
+  uint64 merges;
+} ksm;
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+  if((ksm.zero = kalloc()) == 0)
+    panic("ksminit");
+  memset(ksm.zero, 0, PGSIZE);
+}
+
+// Return the zero page, with a reference taken for the caller's
+// mapping. It must be mapped without PTE_W.
+uint64
+zeropage(void)
+{
+  krefinc(ksm.zero);
+  return (uint64)ksm.zero;
+}
+
+static uint64
+pagehash(char *pa)
+{
+  uint64 *w = (uint64*)pa;
+  uint64 h = 0;
+  int i;
+
+  for(i = 0; i < PGSIZE/sizeof(uint64); i++)
+    h = (h ^ w[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+// mem is a page of read-only program text that the caller has
+// just read in. Return the page the caller should map instead:
+// a page with the same contents already in the table (with a
+// reference taken, and mem freed), or mem itself.
+char*
+ksmmerge(char *mem)
+{
+  uint64 h = pagehash(mem);
+  char *old;
+  int i = h % NKSM;
+
+  acquire(&ksm.lock);
+  if(ksm.tab[i].pa && ksm.tab[i].hash == h &&
+     memcmp(ksm.tab[i].pa, mem, PGSIZE) == 0){
+    old = mem;
+    mem = ksm.tab[i].pa;
+    krefinc(mem);
+    ksm.merges++;
+  } else {
+    // replace whatever page was in the entry.
+    old = ksm.tab[i].pa;
+    ksm.tab[i].pa = mem;
+    ksm.tab[i].hash = h;
+    krefinc(mem);
+  }
+  release(&ksm.lock);
+  if(old)
+    kfree(old);
+  return mem;
+}
+
+// Give up the table's references to its pages, for
+// kallocreclaim(). Returns the number of pages given up.
+int
+ksmflush(void)
+{
+  char *pa[NKSM];
+  int i, n = 0;
+
+  acquire(&ksm.lock);
+  for(i = 0; i < NKSM; i++){
+    if(ksm.tab[i].pa){
+      pa[n++] = ksm.tab[i].pa;
+      ksm.tab[i].pa = 0;
+    }
+  }
+  release(&ksm.lock);
+  for(i = 0; i < n; i++)
+    kfree(pa[i]);
+  return n;
+}
+
+uint64
+sys_ksmstat(void)
+{
+  uint64 addr;
+  struct ksmstat st;
+  int i, ref;
+
+  argaddr(0, &addr);
+  memset(&st, 0, sizeof(st));
+  acquire(&ksm.lock);
+  st.zeromaps = krefcnt(ksm.zero) - 1;
+  for(i = 0; i < NKSM; i++){
+    if(ksm.tab[i].pa == 0)
+      continue;
+    st.cached++;
+    // one reference is the table's, one the first mapping's.
+    if((ref = krefcnt(ksm.tab[i].pa)) > 2)
+      st.saved += ref - 2;
+  }
+  st.merges = ksm.merges;
+  release(&ksm.lock);
+  st.saved += st.zeromaps;
+  st.freepages = kfreecount();
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
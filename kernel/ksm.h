@@ -0,0 +1,8 @@
+// Page sharing statistics, returned by the ksmstat() system call.
+struct ksmstat {
+  uint64 freepages; // pages on the free list
+  uint64 zeromaps;  // PTEs mapping the shared zero page
+  uint64 cached;    // text pages in the merge table
+  uint64 saved;     // pages not allocated thanks to sharing
+  uint64 merges;    // text pages merged since boot
+};
@@ -4,8 +4,10 @@
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
+#include "log.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -17,39 +19,111 @@
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
+// the count of in-progress FS system calls, reserves log space
+// for the MAXOPBLOCKS blocks the call may write, and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the last outstanding end_op() commits. A call
+// that writes more, like a large write(), uses begin_opn() to
+// reserve what it needs, up to a whole region.
 //
 // The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+// It has NLOGREGION regions, as large as mkfs made them (up to
+// LOGSIZE blocks and a header), each with the on-disk format:
+//   header block, containing a sequence number and
+//     block #s for block A, B, C, ...
 //   block A
 //   block B
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Transactions use the regions in turn, as a circular log. The
+// last end_op() of a transaction copies its blocks out of the
+// buffer cache while no FS system call is active, lets the next
+// transaction start filling the next region, and writes the log
+// and, once the last transaction's header is on disk, the header.
+// That is all it waits for: the flusher kernel
+// thread installs committed transactions at their home
+// locations in sequence order, and then erases the header, which
+// frees the region. A block that a later committed transaction
+// also logged isn't installed, since that transaction will
+// install a newer copy, and recovery replays the committed
+// regions in sequence order.
+//
+// With log.pipeline off, new system calls wait for the whole
+// commit; with log.async off, end_op() waits for the flusher to
+// install its transaction.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint seq;
   int block[LOGSIZE];
 };
 
+#define LOG_FREE       0   // region can take the next transaction
+#define LOG_COMMITTING 1   // end_op() is writing it
+#define LOG_COMMITTED  2   // waiting for the flusher to install it
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int nblock;      // blocks in each region, after the header
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks they have reserved
   int committing;  // in commit(), please wait.
   int dev;
+  int cur;         // region the open transaction will use
+  int tail;        // oldest region not yet installed
+  uint seq;        // sequence number of the open transaction
+  uint durable;    // transactions before this one have their header on disk
+  uint installed;  // transactions before this one are installed
+  int pipeline;    // let the next transaction fill during commits
+  int maxop;       // most blocks a large write's transaction reserves
+  int async;       // don't wait for install in end_op()
   struct logheader lh;
+  int state[NLOGREGION];
+  struct logheader rlh[NLOGREGION];      // each region's header
+  struct buf *copy[NLOGREGION][LOGSIZE]; //   and copies of its blocks
+  struct buf *bp[LOGSIZE];  // bufs to write, for the flusher and recovery
+  struct logstat st;
 };
 struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void flusher(void);
+
+// Block number of region r's header (i 0) or its log block i-1.
+static int
+logblock(int r, int i)
+{
+  return log.start + r*(log.nblock+1) + i;
+}
+
+// Allocate the bufs for copies of the regions' blocks, as many
+// to a page as fit.
+static void
+alloc_copies(void)
+{
+  char *pg = 0;
+  int r, i, off = PGSIZE;
+
+  for (r = 0; r < NLOGREGION; r++) {
+    for (i = 0; i < log.nblock; i++) {
+      if (off + sizeof(struct buf) > PGSIZE) {
+        if ((pg = kalloc()) == 0)
+          panic("initlog: no memory");
+        memset(pg, 0, PGSIZE);
+        off = 0;
+      }
+      log.copy[r][i] = (struct buf*)(pg + off);
+      off += sizeof(struct buf);
+    }
+  }
+}
 
 void
 initlog(int dev, struct superblock *sb)
@@ -60,87 +134,152 @@ initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  log.nblock = sb->nlog / NLOGREGION - 1;
+  if (log.nblock > LOGSIZE)
+    log.nblock = LOGSIZE;
+  if (log.nblock < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  alloc_copies();
+  log.maxop = log.nblock;
+  log.pipeline = 1;
+  log.async = 1;
   recover_from_log();
+  kthread(flusher, "logflush");
 }
 
-// Copy committed blocks from log to their home location
+// Read region r's header from disk into lh.
 static void
-install_trans(int recovering)
+read_head(int r, struct logheader *lh)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
-  }
-}
-
-// Read the log header from disk into the in-memory log header
-static void
-read_head(void)
-{
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
+  struct buf *buf = bread(log.dev, logblock(r, 0));
+  struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  lh->n = hb->n;
+  lh->seq = hb->seq;
+  for (i = 0; i < lh->n; i++) {
+    lh->block[i] = hb->block[i];
   }
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
+// Write lh to region r's header on disk.
 // This is the true point at which the
-// current transaction commits.
+// transaction commits.
 static void
-write_head(void)
+write_head(int r, struct logheader *lh)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(log.dev, logblock(r, 0));
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = lh->n;
+  hb->seq = lh->seq;
+  for (i = 0; i < lh->n; i++) {
+    hb->block[i] = lh->block[i];
   }
   bwrite(buf);
   brelse(buf);
 }
 
+// Copy the committed blocks in region r's log to their home
+// locations, after a crash.
+static void
+recover_trans(int r, struct logheader *lh)
+{
+  int tail;
+  struct buf **dbuf = log.bp;
+
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *lbuf = bread(log.dev, logblock(r, tail+1)); // read log block
+    dbuf[tail] = bread(log.dev, lh->block[tail]); // read dst
+    memmove(dbuf[tail]->data, lbuf->data, BSIZE);  // copy block to dst
+    brelse(lbuf);
+  }
+  bwritestartv(dbuf, lh->n);  // write dst to disk
+  for (tail = 0; tail < lh->n; tail++) {
+    bwait(dbuf[tail]);
+    brelse(dbuf[tail]);
+  }
+}
+
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct logheader *lh = log.rlh;
+  int r, first, i;
+
+  for (r = 0; r < NLOGREGION; r++)
+    read_head(r, &lh[r]);
+  // the region with the newest sequence number was written
+  // last; the committed ones after it are older.
+  first = 0;
+  for (r = 1; r < NLOGREGION; r++)
+    if ((int)(lh[r].seq - lh[first].seq) > 0)
+      first = r;
+  log.seq = lh[first].seq + 1;
+  for (i = 1; i <= NLOGREGION; i++) {
+    r = (first + i) % NLOGREGION;
+    if (lh[r].n > 0)
+      recover_trans(r, &lh[r]); // if committed, copy from log to disk
+  }
+  log.durable = log.installed = log.seq;
+  for (r = 0; r < NLOGREGION; r++) {
+    lh[r].n = 0;
+    lh[r].seq = log.seq - 1;
+    write_head(r, &lh[r]); // clear the log
+  }
 }
 
-// called at the start of each FS system call.
+// called at the start of an FS system call that writes
+// at most n blocks.
 void
-begin_op(void)
+begin_opn(int n)
 {
+  if(n > log.nblock)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
     if(log.committing){
+      log.st.commitwaits++;
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > log.nblock){
       // this op might exhaust log space; wait for commit.
+      log.st.spacewaits++;
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
+      myproc()->logres = n;
+      log.st.ops++;
       release(&log.lock);
       break;
     }
   }
 }
 
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  begin_opn(MAXOPBLOCKS);
+}
+
+// The log blocks a write of n bytes to a file must reserve:
+// the data, as many allocation blocks, the i-node, an indirect
+// block, and 2 blocks of slop for non-aligned writes.
+int
+log_writeblocks(int n)
+{
+  return 2*((n + BSIZE - 1) / BSIZE) + 4;
+}
+
+// The most bytes a single transaction can write to a file.
+int
+log_maxwrite(void)
+{
+  return ((log.maxop - 4) / 2) * BSIZE;
+}
+
 // called at the end of each FS system call.
 // commits if this was the last outstanding operation.
 void
@@ -150,6 +289,8 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= myproc()->logres;
+  myproc()->logres = 0;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
@@ -167,44 +308,197 @@ end_op(void)
     // call commit w/o holding locks, since not allowed
     // to sleep with locks.
     commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy the transaction's blocks from the cache to region r's
+// buffers, while no FS system call can change them.
 static void
-write_log(void)
+copy_log(int r, struct logheader *lh)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *from = bread(log.dev, lh->block[tail]); // cache block
+    memmove(log.copy[r][tail]->data, from->data, BSIZE);
     brelse(from);
-    brelse(to);
   }
 }
 
+// Write region r's buffers to the log.
+static void
+write_log(int r, struct logheader *lh)
+{
+  struct buf **b = log.copy[r];
+  int tail;
+
+  for (tail = 0; tail < lh->n; tail++) {
+    b[tail]->dev = log.dev;
+    b[tail]->blockno = logblock(r, tail+1);
+  }
+  iostartv(b, lh->n, 1);
+  for (tail = 0; tail < lh->n; tail++)
+    iowait(b[tail]);
+}
+
+// Commit the open transaction. Called by the last end_op(),
+// with log.committing set.
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  struct logheader *lh;
+  uint seq;
+  int r, pipeline, async;
+  uint64 start = r_time();
+
+  acquire(&log.lock);
+  if (log.lh.n == 0) {
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
+    return;
+  }
+  // wait for the flusher to free the region.
+  r = log.cur;
+  if (log.state[r] != LOG_FREE)
+    log.st.regionwaits++;
+  while (log.state[r] != LOG_FREE)
+    sleep(&log, &log.lock);
+  log.state[r] = LOG_COMMITTING;
+  lh = &log.rlh[r];
+  *lh = log.lh;
+  lh->seq = seq = log.seq;
+  pipeline = log.pipeline;
+  async = log.async;
+  release(&log.lock);
+
+  copy_log(r, lh);
+
+  acquire(&log.lock);
+  log.lh.n = 0;
+  log.cur = (r + 1) % NLOGREGION;
+  log.seq++;
+  if (pipeline) {
+    log.committing = 0;
+    wakeup(&log);
+  }
+  release(&log.lock);
+
+  write_log(r, lh);  // Write the copies to the log
+
+  // the copies may hold the last transaction's changes too, so
+  // its header must reach the disk first, or recovery could
+  // replay this transaction without it.
+  acquire(&log.lock);
+  while (log.durable != seq)
+    sleep(&log.durable, &log.lock);
+  release(&log.lock);
+
+  write_head(r, lh); // Write header to disk -- the real commit
+
+  acquire(&log.lock);
+  log.durable = seq + 1;
+  wakeup(&log.durable);
+  log.st.commits++;
+  log.st.blocks += lh->n;
+  log.state[r] = LOG_COMMITTED;
+  wakeup(&log.installed);
+  if (!async) {
+    while ((int)(log.installed - seq) <= 0)
+      sleep(&log, &log.lock);
+  }
+  if (!pipeline) {
+    log.committing = 0;
+    wakeup(&log);
+  }
+  log.st.commitus += (r_time() - start) / 10;
+  release(&log.lock);
+}
+
+// Is block in a committed transaction after region r's?
+// Caller holds log.lock.
+static int
+relogged(int r, int block)
+{
+  int i, j;
+
+  for (i = (r + 1) % NLOGREGION; i != log.cur; i = (i + 1) % NLOGREGION) {
+    if (log.state[i] != LOG_COMMITTED)
+      continue;
+    for (j = 0; j < log.rlh[i].n; j++)
+      if (log.rlh[i].block[j] == block)
+        return 1;
+  }
+  return 0;
+}
+
+// Write region r's committed blocks to their home locations,
+// except those a later committed transaction will write, and
+// let the cache evict them. Returns the number written.
+static int
+install_trans(int r)
+{
+  struct logheader *lh = &log.rlh[r];
+  struct buf **b = log.bp;
+  int tail, n = 0;
+
+  acquire(&log.lock);
+  for (tail = 0; tail < lh->n; tail++) {
+    if (relogged(r, lh->block[tail])) {
+      log.st.absorbed++;
+      continue;
+    }
+    b[n] = log.copy[r][tail];
+    b[n]->dev = log.dev;
+    b[n]->blockno = lh->block[tail];
+    n++;
+  }
+  release(&log.lock);
+
+  iostartv(b, n, 1);  // install writes to home locations
+  for (tail = 0; tail < n; tail++)
+    iowait(b[tail]);
+
+  for (tail = 0; tail < lh->n; tail++) {
+    struct buf *dbuf = bread(log.dev, lh->block[tail]); // pinned, so cached
+    bunpin(dbuf);
+    brelse(dbuf);
+  }
+  return n;
+}
+
+// The flusher kernel thread: install committed transactions in
+// sequence order, and free their regions.
+static void
+flusher(void)
+{
+  int r, n;
+
+  intr_on();
+  acquire(&log.lock);
+  for (;;) {
+    r = log.tail;
+    while (log.state[r] != LOG_COMMITTED)
+      sleep(&log.installed, &log.lock);
+    release(&log.lock);
+
+    n = install_trans(r);
+    log.rlh[r].n = 0;   // only the flusher uses the region now
+    write_head(r, &log.rlh[r]); // Erase the transaction from the log
+
+    acquire(&log.lock);
+    log.state[r] = LOG_FREE;
+    log.tail = (r + 1) % NLOGREGION;
+    log.installed++;
+    log.st.installs++;
+    log.st.installblocks += n;
+    wakeup(&log);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// commit()/copy_log() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -217,7 +511,7 @@ log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.nblock)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -234,3 +528,40 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+// Copy out the log's statistics to addr. If pipeline is 0 or 1,
+// turn off or on letting new system calls run while a
+// transaction commits; if async is 0 or 1, turn off or on
+// returning from end_op() before the transaction is installed;
+// if maxop is positive, make it the most blocks a write()'s
+// transaction may reserve (MAXOPBLOCKS, at least, and a region,
+// at most).
+uint64
+sys_logstat(void)
+{
+  uint64 addr;
+  int pipeline, async, maxop;
+  struct logstat st;
+
+  argaddr(0, &addr);
+  argint(1, &pipeline);
+  argint(2, &async);
+  argint(3, &maxop);
+  acquire(&log.lock);
+  if (maxop > 0)
+    log.maxop = maxop < MAXOPBLOCKS ? MAXOPBLOCKS :
+                maxop > log.nblock ? log.nblock : maxop;
+  if (pipeline == 0 || pipeline == 1)
+    log.pipeline = pipeline;
+  if (async == 0 || async == 1)
+    log.async = async;
+  st = log.st;
+  st.pipeline = log.pipeline;
+  st.async = log.async;
+  st.nregion = NLOGREGION;
+  st.nblock = log.nblock;
+  st.maxop = log.maxop;
+  release(&log.lock);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
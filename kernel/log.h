@@ -0,0 +1,18 @@
+// Log statistics, returned by the logstat() system call.
+struct logstat {
+  int pipeline;         // new transactions fill during commits
+  int async;            // end_op() doesn't wait for the install
+  int nregion;          // log regions
+  int nblock;           //   and blocks in each, after the header
+  int maxop;            // most blocks a write()'s transaction reserves
+  uint64 ops;           // FS system calls
+  uint64 commits;       // transactions committed
+  uint64 blocks;        //   and the blocks they logged
+  uint64 commitus;      //   and microseconds end_op() spent on them
+  uint64 installs;      // transactions installed by the flusher
+  uint64 installblocks; //   and the blocks it wrote home
+  uint64 absorbed;      //   and didn't, as a later one had them too
+  uint64 commitwaits;   // begin_op()s that waited for a commit
+  uint64 spacewaits;    //   and for log space
+  uint64 regionwaits;   // commits that waited for a free region
+};
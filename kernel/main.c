@@ -4,6 +4,8 @@
 #include "riscv.h"
 #include "defs.h"
 
+extern pagetable_t kernel_pagetable;
+
 volatile static int started = 0;
 
 // start() jumps here in supervisor mode on all CPUs.
@@ -19,6 +21,8 @@ main()
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    vmsummary("kernel page table", kernel_pagetable);
+    asidinit();      // address-space identifiers
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -27,6 +31,10 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    swapinit();      // swap area
+    ksminit();       // zero page and text page sharing
+    fpinit();        // shared pages of mmap()ed files
+    iosinit();       // disk request scheduler
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
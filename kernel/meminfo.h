@@ -0,0 +1,24 @@
+// Memory statistics, returned by the meminfo() system call.
+struct meminfo {
+  uint64 npages;          // pages of RAM the allocator manages
+  uint64 nfree;           // pages on the free list
+  uint64 nalloc[NCPU];    // pages allocated by each hart
+  uint64 nfreed[NCPU];    // pages freed by each hart
+};
+
+// One process's memory, in pages.
+struct procmem {
+  int pid;
+  int state;              // enum procstate
+  char name[16];
+  uint64 sz;              // bytes of user memory
+  uint text;              // resident pages of read-only program segments
+  uint data;              // ... of writable program segments
+  uint stack;             // ... of the user stack
+  uint heap;              // ... of the heap
+  uint mmap;              // ... of mmap() regions
+  uint shared;            // resident pages mapped more than once
+  uint swapped;           // pages out in swap
+  uint pagetable;         // page-table pages
+  uint kernel;            // kernel stack, trapframe and usyscall pages
+};
@@ -55,9 +55,12 @@
 // Address zero first:
 //   text
 //   original data and bss
-//   fixed-size stack
 //   expandable heap
 //   ...
+//   guard page
+//   user stack, growing down from USTACKTOP to USTACKLIM
+//   mmap() regions, from MMAPTOP down to MMAPBASE
+//   ...
 //   USYSCALL (shared with kernel)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
@@ -65,7 +68,32 @@
 #ifdef LAB_PGTBL
 #define USYSCALL (TRAPFRAME - PGSIZE)
 
+// A read-only page the kernel refreshes on every return to user
+// space, so that user code can read these without a system call
+// (see ugetusyscall() in user/ulib.c). seq is odd while the kernel
+// is in the middle of an update.
 struct usyscall {
-  int pid;  // Process ID
+  int pid;          // Process ID
+  uint seq;         // update sequence number
+  uint64 ticks;     // clock ticks since boot, as uptime() returns
+  int hartid;       // hart the process is running on
+  int prio;         // current (aged) priority
+  int base_prio;    // base priority
+  int pad;
+  uint64 nsched;    // times scheduled onto a hart
+  uint64 runticks;  // timer ticks while running
 };
 #endif
+
+// mmap() places regions between MMAPBASE and MMAPTOP,
+// highest first.
+#define MMAPBASE (MAXVA / 2)
+#define MMAPTOP  (TRAPFRAME - 16*PGSIZE)
+
+// The user stack sits just below the mmap() area, and vmfault()
+// maps its pages as it grows down, to at most USTACKMAX pages.
+// The page below USTACKLIM is never mapped, to catch overflow:
+// sbrk() never grows the heap past HEAPTOP.
+#define USTACKTOP MMAPBASE
+#define USTACKLIM (USTACKTOP - USTACKMAX*PGSIZE)
+#define HEAPTOP   (USTACKLIM - PGSIZE)
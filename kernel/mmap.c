@@ -0,0 +1,496 @@
+//
+// mmap() and munmap().
+//
+// Each process has a small table of regions (struct vma) in the
+// range [MMAPBASE, MMAPTOP). Nothing is mapped by mmap() itself:
+// vmfault() calls vmafault() on the first touch of each page,
+// which allocates it and, for a file region, reads it from the
+// file. Dirty pages of MAP_SHARED file regions are written back
+// when they are unmapped by munmap(), exit() or exec().
+//
+// Pages of MAP_SHARED file regions are looked up by file and
+// offset in a table (fpages), so every process that maps a page
+// of a file, including children created by fork(), maps the same
+// physical page. An entry lasts until the last mapping of its
+// page goes away. The pages are not kept coherent with read()
+// and write() of the file, which go through the buffer cache.
+// Shared memory segments (shm.c), including anonymous MAP_SHARED
+// memory, are shared by every process that maps them.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+
+#define NFPAGE  1024  // pages of MAP_SHARED file regions in use
+#define NFPHASH 61    // hash chains of fpages
+
+struct fpage {
+  uint dev, inum;
+  uint off;         // page-aligned offset in the file
+  char *pa;         // 0 if the entry is free
+  int next;         // next entry in the hash chain, or -1
+};
+
+struct {
+  struct spinlock lock;
+  struct fpage tab[NFPAGE];
+  int head[NFPHASH];   // first entry of each chain, or -1
+  int free;            // first free entry, chained through next
+} fpages;
+
+void
+fpinit(void)
+{
+  int i;
+
+  initlock(&fpages.lock, "fpages");
+  for(i = 0; i < NFPHASH; i++)
+    fpages.head[i] = -1;
+  for(i = 0; i < NFPAGE; i++)
+    fpages.tab[i].next = i + 1 < NFPAGE ? i + 1 : -1;
+  fpages.free = 0;
+}
+
+static int
+fphash(struct inode *ip, uint off)
+{
+  return (ip->dev * 31 + ip->inum * 17 + off / PGSIZE) % NFPHASH;
+}
+
+// Return the page of ip at off, with a reference taken.
+// Caller holds fpages.lock.
+static char*
+fplookup(struct inode *ip, uint off)
+{
+  struct fpage *e;
+  int i;
+
+  for(i = fpages.head[fphash(ip, off)]; i >= 0; i = e->next){
+    e = &fpages.tab[i];
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off){
+      krefinc(e->pa);
+      return e->pa;
+    }
+  }
+  return 0;
+}
+
+// Return the page of ip at page-aligned offset off for a
+// MAP_SHARED mapping, with a reference taken for the caller's
+// mapping: the one every process mapping it shares, or one read
+// from the file now. Returns 0 if out of memory or entries.
+static char*
+fpget(struct inode *ip, uint off)
+{
+  struct fpage *e;
+  char *mem, *pa;
+  int i, h = fphash(ip, off);
+
+  acquire(&fpages.lock);
+  pa = fplookup(ip, off);
+  release(&fpages.lock);
+  if(pa)
+    return pa;
+
+  if((mem = kallocreclaim()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  // a short read at the end of the file leaves the rest zero.
+  if(readipage(ip, mem, off, PGSIZE) < 0){
+    kfree(mem);
+    return 0;
+  }
+
+  // another process may have read the page in meanwhile.
+  acquire(&fpages.lock);
+  if((pa = fplookup(ip, off)) == 0 && (i = fpages.free) >= 0){
+    e = &fpages.tab[i];
+    fpages.free = e->next;
+    e->dev = ip->dev;
+    e->inum = ip->inum;
+    e->off = off;
+    e->pa = pa = mem;
+    e->next = fpages.head[h];
+    fpages.head[h] = i;
+    krefinc(mem);   // the entry's reference
+    mem = 0;
+  }
+  release(&fpages.lock);
+  if(mem)
+    kfree(mem);
+  return pa;
+}
+
+// Drop the entries for pages of ip in [off, end) that no page
+// table maps any more, since mappings of [off, end) have just
+// gone away.
+static void
+fpput(struct inode *ip, uint off, uint end)
+{
+  struct fpage *e;
+  int *pp, h;
+
+  acquire(&fpages.lock);
+  for(h = 0; h < NFPHASH; h++){
+    for(pp = &fpages.head[h]; *pp >= 0; ){
+      e = &fpages.tab[*pp];
+      if(e->dev == ip->dev && e->inum == ip->inum &&
+         e->off >= off && e->off < end && krefcnt(e->pa) == 1){
+        kfree(e->pa);
+        e->pa = 0;
+        *pp = e->next;
+        e->next = fpages.free;
+        fpages.free = e - fpages.tab;
+      } else {
+        pp = &e->next;
+      }
+    }
+  }
+  release(&fpages.lock);
+}
+
+// Return the region of p that contains va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start != 0 && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// Return a region of p that overlaps [a, a+len), or 0.
+static struct vma*
+vmaoverlap(struct proc *p, uint64 a, uint64 len)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start != 0 && a < v->end && a + len > v->start)
+      return v;
+  return 0;
+}
+
+// Choose the address of a new region of len bytes: addr itself
+// if that range is page-aligned, inside the mmap area and free,
+// otherwise the highest free range below MMAPTOP.
+// Returns 0 if there is no room.
+static uint64
+vmaplace(struct proc *p, uint64 addr, uint64 len)
+{
+  struct vma *v;
+  uint64 a;
+
+  if(addr != 0 && addr % PGSIZE == 0 && addr >= MMAPBASE &&
+     addr <= MMAPTOP - len && vmaoverlap(p, addr, len) == 0)
+    return addr;
+
+  a = MMAPTOP - len;
+  while((v = vmaoverlap(p, a, len)) != 0){
+    if(v->start < MMAPBASE + len)
+      return 0;
+    a = v->start - len;
+  }
+  return a;
+}
+
+// Allocate the page at va of region v, read its contents from
+// v's file (if any), and map it into pagetable.
+// Returns the physical address, or 0 on failure.
+static uint64
+vmapagein(pagetable_t pagetable, struct vma *v, uint64 va)
+{
+  char *mem;
+  uint64 pa;
+  int perm = PTE_U;
+
+  if(v->prot & PROT_READ)
+    perm |= PTE_R;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_R | PTE_W;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+
+  if(v->f && v->f->type == FD_SHM){
+    // map the segment's own page, or a private copy of it.
+    if((pa = shmpage(v->f->shm, (v->off + (va - v->start)) / PGSIZE)) == 0)
+      return 0;
+    mem = (char*)pa;
+    if(v->flags & MAP_PRIVATE){
+      mem = kallocreclaim();
+      if(mem)
+        memmove(mem, (char*)pa, PGSIZE);
+      kfree((char*)pa);
+      if(mem == 0)
+        return 0;
+    }
+  } else if(v->f && (v->flags & MAP_SHARED)){
+    if((mem = fpget(v->f->ip, v->off + (va - v->start))) == 0)
+      return 0;
+  } else {
+    if((mem = kallocreclaim()) == 0)
+      return 0;
+    memset(mem, 0, PGSIZE);
+    // a short read at the end of the file leaves the rest zero.
+    if(v->f && readipage(v->f->ip, mem, v->off + (va - v->start), PGSIZE) < 0){
+      kfree(mem);
+      return 0;
+    }
+  }
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return 0;
+  }
+  return (uint64)mem;
+}
+
+// Handle a page fault at va, which lies in region v and is
+// not mapped yet. read is 0 for a store.
+// Returns the physical address, or 0 if the access is not
+// allowed or there is no memory.
+uint64
+vmafault(pagetable_t pagetable, struct vma *v, uint64 va, int read)
+{
+  if(read && (v->prot & (PROT_READ|PROT_WRITE|PROT_EXEC)) == 0)
+    return 0;
+  if(!read && (v->prot & PROT_WRITE) == 0)
+    return 0;
+  return vmapagein(pagetable, v, PGROUNDDOWN(va));
+}
+
+// Write the page at pa back to ip at offset off, without growing
+// the file, in transactions small enough to fit in the log.
+// Returns -1 if the write failed.
+static int
+vmawritepage(struct inode *ip, uint64 pa, uint off)
+{
+  int r = 0;
+
+  int max = log_maxwrite();
+  uint i, n;
+
+  for(i = 0; i < PGSIZE; i += n){
+    n = PGSIZE - i;
+    if(n > max)
+      n = max;
+    begin_opn(log_writeblocks(n));
+    ilock(ip);
+    if(off + i >= ip->size){
+      iunlock(ip);
+      end_op();
+      break;
+    }
+    if(off + i + n > ip->size)
+      n = ip->size - (off + i);
+    if(writei(ip, 0, pa + i, off + i, n) != n)
+      r = -1;
+    iunlock(ip);
+    end_op();
+    if(r < 0)
+      break;
+  }
+  return r;
+}
+
+// Unmap [a, b) of region v from p's page table, first writing
+// dirty pages of a shared file region back to the file.
+// Returns -1 if some page couldn't be written back.
+static int
+vmaunmap(struct proc *p, struct vma *v, uint64 a, uint64 b)
+{
+  uint64 va;
+  pte_t *pte;
+  int r = 0;
+
+  if(v->f && v->f->type == FD_INODE &&
+     (v->flags & MAP_SHARED) && (v->prot & PROT_WRITE)){
+    for(va = a; va < b; va += PGSIZE){
+      if((pte = walk(p->pagetable, va, 0)) == 0)
+        continue;
+      if((*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+        continue;
+      if(vmawritepage(v->f->ip, PTE2PA(*pte), v->off + (va - v->start)) < 0)
+        r = -1;
+      *pte &= ~PTE_D;
+    }
+    tlbstale(p->pagetable);
+  }
+  uvmunmap(p->pagetable, a, (b - a) / PGSIZE, 1);
+  if(v->f && v->f->type == FD_INODE && (v->flags & MAP_SHARED))
+    fpput(v->f->ip, v->off + (a - v->start), v->off + (b - v->start));
+  return r;
+}
+
+// Give np, a child being created by fork(), a copy of p's
+// regions. Mapped pages are shared with the child: writable
+// for MAP_SHARED regions, copy-on-write for the rest.
+// Returns 0 on success, -1 (with nothing copied) on failure.
+int
+vmacopy(struct proc *p, struct proc *np)
+{
+  struct vma *v, *w;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    if(uvmcopyrange(p->pagetable, np->pagetable, v->start, v->end,
+                    v->flags & MAP_SHARED) < 0){
+      for(w = p->vma; w < v; w++)
+        if(w->start != 0)
+          uvmunmap(np->pagetable, w->start, (w->end - w->start) / PGSIZE, 1);
+      return -1;
+    }
+  }
+
+  for(v = p->vma, w = np->vma; v < &p->vma[NVMA]; v++, w++){
+    *w = *v;
+    if(w->f)
+      filedup(w->f);
+  }
+  return 0;
+}
+
+// Unmap all of p's regions, for exit() and exec(), which have
+// nobody to report a failed write-back to but the console.
+void
+vmafreeall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    if(vmaunmap(p, v, v->start, v->end) < 0)
+      printf("pid %d %s: mmap write-back failed\n", p->pid, p->name);
+    if(v->f)
+      fileclose(v->f);
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len, off, start;
+  int prot, flags, fd;
+  struct proc *p = myproc();
+  struct file *f = 0;
+  struct vma *v;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(4, &fd);
+  argaddr(5, &off);
+
+  if(len == 0 || len > MMAPTOP - MMAPBASE)
+    return -1;
+  len = PGROUNDUP(len);
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;   // need exactly one of MAP_SHARED and MAP_PRIVATE
+
+  if(flags & MAP_ANONYMOUS){
+    off = 0;
+  } else {
+    if(fd < 0 || fd >= NOFILE || (f = p->ofile[fd]) == 0)
+      return -1;
+    if(f->type != FD_INODE && f->type != FD_SHM)
+      return -1;
+    if(!f->readable || off % PGSIZE != 0)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return -1;
+  if((start = vmaplace(p, addr, len)) == 0)
+    return -1;
+
+  if(f){
+    f = filedup(f);
+  } else if(flags & MAP_SHARED){
+    // back shared anonymous memory with a segment, so that
+    // children share even the pages first touched after fork().
+    if(shmalloc(&f, len) < 0)
+      return -1;
+  }
+  v->start = start;
+  v->end = start + len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = f;
+  return v->start;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len, a, b;
+  struct proc *p = myproc();
+  struct vma *v, *nv = 0;
+  int r = 0;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if(addr + len < addr)
+    return -1;
+
+  // punching a hole in a region splits it in two, which
+  // needs a free slot; find one before changing anything.
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start != 0 && addr > v->start && addr + len < v->end){
+      for(nv = p->vma; nv < &p->vma[NVMA]; nv++)
+        if(nv->start == 0)
+          break;
+      if(nv == &p->vma[NVMA])
+        return -1;
+    }
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0 || addr + len <= v->start || addr >= v->end)
+      continue;
+    a = addr > v->start ? addr : v->start;
+    b = addr + len < v->end ? addr + len : v->end;
+    if(vmaunmap(p, v, a, b) < 0)
+      r = -1;   // the pages are unmapped all the same
+    if(a == v->start && b == v->end){
+      if(v->f)
+        fileclose(v->f);
+      memset(v, 0, sizeof(*v));
+    } else if(a == v->start){
+      v->off += b - v->start;
+      v->start = b;
+    } else if(b == v->end){
+      v->end = a;
+    } else {
+      *nv = *v;
+      nv->off += b - v->start;
+      nv->start = b;
+      v->end = a;
+      if(nv->f)
+        filedup(nv->f);
+    }
+  }
+  return r;
+}
@@ -7,11 +7,22 @@
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define LOGSIZE      250   // max data blocks in a log region; mkfs sizes it
+#define NLOGREGION   4     // log regions, for transactions awaiting install
+#define NBUF         (MAXOPBLOCKS*3)  // min size of disk block cache
+#define NBUCKET      251   // hash buckets in the block cache
+#define RAMAX        32    // max blocks readi() reads ahead
+#define MAXSEG       16    // max blocks in one disk request
+#define IODEPTH      4     // disk requests in flight at once
+#define FSSIZE       4000  // size of file system in blocks
+#define NSWAP        8192  // swap slots (pages) on disk after the file system
 #define MAXPATH      128   // maximum file path name
-#define USERSTACK    1     // user stack pages
+#define USERSTACK    1     // user stack pages exec() maps for arguments
+#define USTACKMAX    2048  // max user stack pages, faulted in as it grows
+#define NEXECSEG     4     // max loadable ELF segments per program
+#define NVMA         16    // max mmap()ed regions per process
+#define NCOLOR       32    // page colors: cache way size / PGSIZE
+#define NPTCACHE     16    // zeroed page-table pages a process keeps
 
 // --- Priority scheduling parameters ---
 #define NPRIO         32     // # of priority levels, 0 (highest) .. 31 (lowest)
@@ -5,6 +5,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "meminfo.h"
+#include "kpool.h"
 
 struct cpu cpus[NCPU];
 
@@ -45,7 +47,7 @@ proc_mapstacks(pagetable_t kpgtbl)
   struct proc *p;
   
   for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
+    char *pa = kallocpool(KPOOL_KSTACK);
     if(pa == 0)
       panic("kalloc");
     uint64 va = KSTACK((int) (p - proc));
@@ -281,13 +283,29 @@ found:
   p->prio       = PRIO_DEFAULT;
   p->wait_ticks = 0;
   p->rq_next    = 0;
+  p->nsched     = 0;
+  p->runticks   = 0;
+  p->asidgen    = 0;
+  p->tlbstale   = 0;
+  p->wc.l0      = 0;
   // Allocate a trapframe page.
-  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+  if((p->trapframe = (struct trapframe *)kallocpool(KPOOL_TRAPFRAME)) == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
   }
 
+#ifdef LAB_PGTBL
+  // Allocate the page shared with user space.
+  if((p->usyscall = (struct usyscall *)kallocpool(KPOOL_TRAPFRAME)) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
+#endif
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -314,9 +332,15 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+#ifdef LAB_PGTBL
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
+#endif
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
+  ptcachefree(p);
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
@@ -358,6 +382,18 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+#ifdef LAB_PGTBL
+  // map the usyscall page below the trapframe, read-only
+  // for user code.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+#endif
+
   return pagetable;
 }
 
@@ -368,6 +404,10 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+#ifdef LAB_PGTBL
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+#endif
+  uvmunmap(pagetable, USTACKLIM, USTACKMAX, 1);
   uvmfree(pagetable, sz);
 }
 
@@ -397,6 +437,7 @@ userinit(void)
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
+  p->stackbase = USTACKTOP;   // initcode's stack is in its page
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -411,6 +452,24 @@ userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel thread running fn(), which must not return.
+// It has a process slot and a kernel stack but no user memory,
+// and never returns to user space. fn() starts with interrupts
+// off, as schedule() left them.
+void
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->context.ra = (uint64)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  prio_enqueue(p);
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -453,6 +512,27 @@ fork(void)
   }
   np->sz = p->sz;
 
+  // the stack lies apart from the rest of user memory.
+  if(uvmcopyrange(p->pagetable, np->pagetable, p->stackbase, USTACKTOP, 0) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->stackbase = p->stackbase;
+
+  if(vmacopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  memmove(np->execseg, p->execseg, sizeof(p->execseg));
+  np->nexecseg = p->nexecseg;
+  if(p->execip){
+    // can't fail: p runs it, so nothing has it open to write.
+    iexecget(p->execip);
+    np->execip = idup(p->execip);
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -513,6 +593,9 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Write back and unmap mmap()ed regions.
+  vmafreeall(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -522,10 +605,16 @@ exit(int status)
     }
   }
 
+  if(p->execip)
+    iexecput(p->execip);
   begin_op();
   iput(p->cwd);
+  if(p->execip)
+    iput(p->execip);
   end_op();
   p->cwd = 0;
+  p->execip = 0;
+  p->nexecseg = 0;
 
   acquire(&wait_lock);
 
@@ -551,7 +640,7 @@ int
 wait(uint64 addr)
 {
   struct proc *pp;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
@@ -568,11 +657,19 @@ wait(uint64 addr)
         if(pp->state == ZOMBIE){
           // Found one.
           pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
+          if(addr != 0){
+            // copyout() may fault in a page of p's program file
+            // and sleep, so it can't run with spinlocks held.
+            // pp stays a zombie child of p meanwhile, since
+            // only p reaps its children.
+            xstate = pp->xstate;
             release(&pp->lock);
             release(&wait_lock);
-            return -1;
+            if(copyout(p->pagetable, addr, (char *)&xstate,
+                       sizeof(xstate)) < 0)
+              return -1;
+            acquire(&wait_lock);
+            acquire(&pp->lock);
           }
           freeproc(pp);
           release(&pp->lock);
@@ -835,6 +932,45 @@ procdump(void)
     printf("\n");
   }
 }
+// Copy the memory use of up to n processes out to the
+// array of struct procmem at user address addr, for meminfo().
+// Another process's page table is only walked while it isn't
+// running, as in reclaim(): p->lock keeps it from starting on
+// another hart and changing its page table meanwhile. A process
+// running elsewhere is reported without its page counts.
+// Returns the number of processes, or -1.
+int
+procmeminfo(uint64 addr, int n)
+{
+  struct proc *p;
+  struct procmem pm;
+  int i = 0;
+
+  for(p = proc; p < &proc[NPROC] && i < n; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED || p->state == USED){
+      release(&p->lock);
+      continue;
+    }
+    memset(&pm, 0, sizeof(pm));
+    pm.pid = p->pid;
+    pm.state = p->state;
+    safestrcpy(pm.name, p->name, sizeof(pm.name));
+    pm.sz = p->sz;
+    if(p->state != RUNNING || p == myproc())
+      uvmstat(p, &pm);
+    pm.kernel = 2;   // kernel stack and trapframe
+#ifdef LAB_PGTBL
+    pm.kernel++;     // usyscall page
+#endif
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, addr + i*sizeof(pm), (char*)&pm, sizeof(pm)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
 void
 backtrace(void)
 {
@@ -885,6 +1021,7 @@ schedule(void)
     if(next->state == RUNNABLE){
       next->state = RUNNING;
       next->wait_ticks = 0;
+      next->nsched++;
       release(&next->lock);
       break;
     }
@@ -935,7 +1072,7 @@ alloc_idleproc(void)
       p->rq_next = 0;
 
       // 和普通进程一样分配 trapframe 和 pagetable（必须）
-     if((p->trapframe = (struct trapframe*)kalloc()) == 0){
+     if((p->trapframe = (struct trapframe*)kallocpool(KPOOL_TRAPFRAME)) == 0){
         release(&p->lock);
         panic("idle trapframe");
       }
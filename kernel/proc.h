@@ -26,6 +26,10 @@ struct cpu {
   int intena;                 // Were interrupts enabled before push_off()?
   struct proc *idleproc;   // 新增：该 CPU 的 idle 进程
   int preempt_pending; 
+  uint64 asidgen;             // ASID generation this hart's TLB is flushed for
+  uint64 ntrap;               // tlbstat() counts: returns to user space,
+  uint64 nfullflush;          //   whole-TLB flushes,
+  uint64 nasidflush;          //   and flushes of one ASID
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,6 +83,38 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 tlbflush;      // no ASIDs: flush the TLB around satp switches
+};
+
+// A loadable ELF segment of the running program, filled in
+// page by page on first touch (see execload() in exec.c).
+struct execseg {
+  uint64 va;                   // page-aligned start
+  uint64 memsz;                // bytes mapped
+  uint64 filesz;               // bytes backed by the file; rest are zero
+  uint64 off;                  // file offset of va
+  int perm;                    // PTE_X/PTE_W from the program header
+};
+
+// A region of the address space created by mmap(). Pages are
+// allocated (and read from f, if any) on first touch, and dirty
+// MAP_SHARED file pages are written back on munmap() and exit.
+struct vma {
+  uint64 start;                // page-aligned; 0 if slot is free
+  uint64 end;                  // page-aligned, exclusive
+  int prot;                    // PROT_*
+  int flags;                   // MAP_*
+  struct file *f;              // backing file; 0 if anonymous
+  uint64 off;                  // file offset of start
+};
+
+// The level-0 page-table page that last translated a user
+// address for copyin(), copyout() or copyinstr() (see uwalk()).
+// Page-table pages are only freed with the whole page table,
+// so l0 stays valid until exec() or exit().
+struct walkcache {
+  uint64 tag;                  // va >> PXSHIFT(1) of the addresses l0 maps
+  pagetable_t l0;              // 0 if empty
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
@@ -91,6 +127,8 @@ struct proc {
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+  int kpreempted;              // If non-zero, preempted in the kernel
+  int pinned;                  // If non-zero, reclaim() leaves its pages (uvmpin())
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
 
@@ -100,16 +138,34 @@ struct proc {
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
+  uint64 stackbase;            // Bottom of the user stack
   pagetable_t pagetable;       // User page table
+  int asid;                    // ASID of pagetable, if asidgen is current
+  uint64 asidgen;              // ASID generation asid belongs to
+  int asidhart;                // hart whose TLB last held asid's entries
+  int tlbstale;                // pagetable changed since the last flush
+  struct walkcache wc;         // last level-0 page of pagetable walked
+  pagetable_t ptcache;        // zeroed page-table pages, linked by PTE 0
+  int nptcache;                // pages on ptcache
+  int logres;                  // log blocks begin_opn() reserved
   struct trapframe *trapframe; // data page for trampoline.S
+#ifdef LAB_PGTBL
+  struct usyscall *usyscall;   // page shared read-only with user space
+#endif
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *execip;        // Program file, for demand paging
+  struct execseg execseg[NEXECSEG]; // Program segments, paged in on demand
+  int nexecseg;                // Number of valid entries in execseg
+  struct vma vma[NVMA];        // mmap()ed regions
   char name[16];               // Process name (debugging)
     // --- priority scheduling fields ---
   int base_prio;          // 可选：记录初始/静态基准优先级（本实现中未强依赖）
   int prio;               // 当前动态优先级：0..31，数字越小越高
   int wait_ticks;         // 仅当进程处于 RUNNABLE 且在就绪队列中时累计；用于 aging
+  uint64 nsched;          // 被调度上 CPU 的次数
+  uint64 runticks;        // 运行时经历的时钟中断数
 
   // 链表指针：用于把进程挂在某个优先级队列上（全局就绪队列）
   struct proc *rq_next;
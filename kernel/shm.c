@@ -0,0 +1,116 @@
+//
+// Shared memory segments.
+//
+// shmcreate() returns a file descriptor for a new, zero-filled
+// segment of memory, which processes map with
+// mmap(addr, len, prot, MAP_SHARED, fd, off). Every mapping of a
+// segment, in any process, maps the segment's own physical pages,
+// so stores through one are seen through all the others.
+// Mappings hold a reference to the segment's file, so the segment
+// lives until the last descriptor and the last mapping are gone.
+// mmap(MAP_SHARED|MAP_ANONYMOUS) memory is a segment too.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+
+#define NSHMDIR  16                    // pages of page addresses
+#define SHMNPTR  (PGSIZE/sizeof(uint64))  // page addresses per dir page
+#define SHMMAX   (NSHMDIR*SHMNPTR*PGSIZE) // max segment size (32 MiB)
+
+struct shm {
+  struct spinlock lock;
+  uint64 npages;
+  uint64 *dir[NSHMDIR];  // physical page addresses; 0 until touched
+};
+
+// Allocate a segment of size bytes (rounded up to whole pages)
+// and a file for it.
+int
+shmalloc(struct file **f, uint64 size)
+{
+  struct shm *s;
+
+  s = 0;
+  *f = 0;
+  if(size == 0 || size > SHMMAX)
+    goto bad;
+  if((*f = filealloc()) == 0)
+    goto bad;
+  if((s = (struct shm*)kalloc()) == 0)
+    goto bad;
+  memset(s, 0, sizeof(*s));
+  initlock(&s->lock, "shm");
+  s->npages = PGROUNDUP(size) / PGSIZE;
+  (*f)->type = FD_SHM;
+  (*f)->readable = 1;
+  (*f)->writable = 1;
+  (*f)->shm = s;
+  return 0;
+
+ bad:
+  if(s)
+    kfree((char*)s);
+  if(*f)
+    fileclose(*f);
+  return -1;
+}
+
+// Return the physical address of page i of segment s, allocating
+// it on first use, with a reference taken for the caller's mapping.
+// Returns 0 if i is past the end of s or there is no memory.
+uint64
+shmpage(struct shm *s, uint64 i)
+{
+  uint64 **d, *pp, pa;
+  char *mem;
+
+  acquire(&s->lock);
+  if(i >= s->npages)
+    goto bad;
+  d = &s->dir[i / SHMNPTR];
+  if(*d == 0){
+    if((*d = (uint64*)kalloc()) == 0)
+      goto bad;
+    memset(*d, 0, PGSIZE);
+  }
+  pp = &(*d)[i % SHMNPTR];
+  if(*pp == 0){
+    if((mem = kalloc()) == 0)
+      goto bad;
+    memset(mem, 0, PGSIZE);
+    *pp = (uint64)mem;
+  }
+  pa = *pp;
+  krefinc((void*)pa);
+  release(&s->lock);
+  return pa;
+
+ bad:
+  release(&s->lock);
+  return 0;
+}
+
+// Free segment s, when the last reference to its file goes away.
+void
+shmclose(struct shm *s)
+{
+  int i, j;
+
+  for(i = 0; i < NSHMDIR; i++){
+    if(s->dir[i] == 0)
+      continue;
+    for(j = 0; j < SHMNPTR; j++)
+      if(s->dir[i][j])
+        kfree((void*)s->dir[i][j]);
+    kfree((void*)s->dir[i]);
+  }
+  kfree((char*)s);
+}
@@ -7,6 +7,10 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // Statistics:
+  uint64 n;          // times acquired
+  uint64 nts;        // failed test-and-sets while waiting for it
 };
 
 #endif
\ No newline at end of file
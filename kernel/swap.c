@@ -0,0 +1,367 @@
+//
+// Page reclaim and swapping of user pages.
+//
+// When kalloc() runs dry, callers that may sleep use
+// kallocreclaim(), which calls reclaim(): a clock sweep over
+// the private user memory of every process: the program and
+// heap [0, sz), the stack, and MAP_PRIVATE regions. Pages of
+// MAP_SHARED regions and segments are left alone, since other
+// page tables map them and dirty file pages must be written
+// back to the file rather than to swap. A page whose PTE_A
+// bit is set gets a second chance: the bit is cleared. A cold
+// page of program text is dropped, since vmfault() can read it
+// from the program file again. A cold private page is written
+// to a free slot of the swap area, which mkfs reserves after
+// the file system, and its PTE is replaced by a PTE_SWAP entry
+// holding the slot number. A fault on a PTE_SWAP entry reads
+// the page back (swapin()).
+//
+// A slot has a reference count, since fork() copies PTE_SWAP
+// entries, and is busy while its page is being written out;
+// swapin() waits for a busy slot.
+//
+// reclaim() edits other processes' page tables while they are
+// not running. It holds a process's p->lock while scanning it,
+// so the process can't start running on another hart and its
+// page table can't be freed, and sets p->tlbstale if it changes
+// anything, so the process flushes its ASID before it runs in
+// user space again (see asid.c). It skips processes that were
+// preempted inside the kernel, since they may hold a physical
+// address they got from walk(), and processes that pinned their
+// pages for a copy under an inode lock (uvmpin()). Several harts may run reclaim()
+// at once; swap.lock protects the clock hand.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+#include "fs.h"
+#include "buf.h"
+#include "fcntl.h"
+#include "swap.h"
+
+#define NRECLAIM 16   // pages reclaim() tries to free per call
+
+#define SLOT2PTE(s) (((uint64)(s)) << 10)
+#define PTE2SLOT(pte) ((uint)((pte) >> 10))
+
+extern struct proc proc[NPROC];
+extern struct superblock sb;
+
+struct {
+  struct spinlock lock;
+  ushort ref[NSWAP];     // PTE_SWAP entries naming each slot
+  char busy[NSWAP];      // slot is being written
+  uint next;             // where swapalloc() starts looking
+  int hand;              // clock hand: index into proc[]
+  uint64 handva;         //   and address in that process
+  struct swapstat st;
+
+  struct sleeplock iolock; // protects buf
+  struct buf buf;          // for swap I/O, bypassing the buffer cache
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.iolock, "swapio");
+}
+
+static uint
+nslots(void)
+{
+  return sb.nswap < NSWAP ? sb.nswap : NSWAP;
+}
+
+// Allocate a free swap slot, marked busy, with one reference.
+// Returns -1 if swap is full.
+static int
+swapalloc(void)
+{
+  uint i, s, n = nslots();
+
+  acquire(&swap.lock);
+  for(i = 0; i < n; i++){
+    s = (swap.next + i) % n;
+    if(swap.ref[s] == 0 && !swap.busy[s]){
+      swap.ref[s] = 1;
+      swap.busy[s] = 1;
+      swap.next = s + 1;
+      swap.st.inuse++;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// fork() has copied PTE_SWAP entry pte into the child.
+void
+swapdup(pte_t pte)
+{
+  acquire(&swap.lock);
+  swap.ref[PTE2SLOT(pte)]++;
+  release(&swap.lock);
+}
+
+// A PTE_SWAP entry naming slot s has gone away.
+static void
+swapfree(uint s)
+{
+  acquire(&swap.lock);
+  if(swap.ref[s] < 1)
+    panic("swapfree");
+  if(--swap.ref[s] == 0)
+    swap.st.inuse--;
+  release(&swap.lock);
+}
+
+// Read or write the page at pa from or to slot s.
+static void
+swapio(char *pa, uint s, int write)
+{
+  struct buf *b = &swap.buf;
+  int i;
+
+  acquiresleep(&swap.iolock);
+  b->dev = ROOTDEV;
+  for(i = 0; i < PGSIZE/BSIZE; i++){
+    b->blockno = sb.swapstart + s*(PGSIZE/BSIZE) + i;
+    if(write)
+      memmove(b->data, pa + i*BSIZE, BSIZE);
+    iorw(b, write);
+    if(!write)
+      memmove(pa + i*BSIZE, b->data, BSIZE);
+  }
+  releasesleep(&swap.iolock);
+}
+
+// Look at the page mapped by pte at va in p.
+// Clear PTE_A if set; otherwise drop the page if it is clean
+// program text, or unmap it and record it in *pa and *slot for
+// the caller to write out if it is private. Returns 1 if the
+// page was dropped, 2 if it is to be written out, 0 otherwise.
+// Caller holds p->lock, so p can't start running, and any change
+// sets p->tlbstale, so p flushes its ASID before it does.
+static int
+reclaimpte(struct proc *p, uint64 va, pte_t *pte, uint64 *pa, int *slot)
+{
+  uint64 e = *pte;
+
+  if((e & PTE_V) == 0 || (e & PTE_U) == 0)
+    return 0;
+  if(e & PTE_A){
+    *pte = e & ~PTE_A;
+    p->tlbstale = 1;
+    return 0;
+  }
+  *pa = PTE2PA(e);
+  if(krefcnt((void*)*pa) != 1)
+    return 0;   // shared with another page table
+  if((e & (PTE_W|PTE_COW)) == 0){
+    if(execseg(p, va) == 0)
+      return 0;
+    *pte = 0;
+    p->tlbstale = 1;
+    kfree((void*)*pa);
+    return 1;
+  }
+  if((*slot = swapalloc()) < 0)
+    return 0;
+  *pte = SLOT2PTE(*slot) | (PTE_FLAGS(e) & ~(PTE_V|PTE_A|PTE_D)) | PTE_SWAP;
+  p->tlbstale = 1;
+  return 2;
+}
+
+// Return the start of the first range of p's memory that
+// reclaim() may take pages from at or after va (va itself if it
+// is inside one), and set *end to the range's end. Returns MAXVA
+// if there are no more. Caller holds p->lock.
+static uint64
+nextrange(struct proc *p, uint64 va, uint64 *end)
+{
+  struct vma *v;
+  uint64 start = MAXVA;
+
+  if(va < p->sz){
+    *end = p->sz;
+    return va;
+  }
+  if(va < USTACKTOP && p->stackbase < USTACKTOP){
+    *end = USTACKTOP;
+    return va > p->stackbase ? va : p->stackbase;
+  }
+  *end = MAXVA;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0 || (v->flags & MAP_PRIVATE) == 0 || v->end <= va)
+      continue;
+    if(v->start < start){
+      start = v->start;
+      *end = v->end;
+    }
+  }
+  return va > start ? va : start;
+}
+
+// Free up to NRECLAIM pages of user memory, continuing the
+// clock sweep where the last call left off. May sleep.
+// Returns the number of pages freed.
+int
+reclaim(void)
+{
+  struct { uint64 pa; int slot; } out[NRECLAIM];
+  struct proc *p;
+  pte_t *pte;
+  uint64 va, end, pa;
+  int i, hand, nout = 0, ndrop = 0, slot;
+
+  // visit every process twice, so that a page whose PTE_A
+  // was cleared on the first visit can go on the second.
+  for(i = 0; i <= 2*NPROC && nout + ndrop < NRECLAIM; i++){
+    acquire(&swap.lock);
+    hand = swap.hand;
+    va = swap.handva;
+    release(&swap.lock);
+    p = &proc[hand];
+    acquire(&p->lock);
+    if((p->state == SLEEPING || p->state == RUNNABLE ||
+        (p->state == RUNNING && p == myproc())) && !p->kpreempted &&
+       !p->pinned){
+      while(nout + ndrop < NRECLAIM &&
+            (va = nextrange(p, va, &end)) != MAXVA){
+        for(; va < end && nout + ndrop < NRECLAIM; va += PGSIZE){
+          if((pte = walk(p->pagetable, va, 0)) == 0){
+            va |= (1L << PXSHIFT(1)) - PGSIZE;  // no L0 table: skip its range
+            continue;
+          }
+          switch(reclaimpte(p, va, pte, &pa, &slot)){
+          case 1:
+            ndrop++;
+            break;
+          case 2:
+            out[nout].pa = pa;
+            out[nout].slot = slot;
+            nout++;
+            break;
+          }
+        }
+      }
+    } else {
+      va = MAXVA;
+    }
+    if(nextrange(p, va, &end) == MAXVA){
+      hand = (hand + 1) % NPROC;
+      va = 0;
+    }
+    release(&p->lock);
+    // another hart's reclaim() may have moved the hand meanwhile;
+    // either position will do.
+    acquire(&swap.lock);
+    swap.hand = hand;
+    swap.handva = va;
+    release(&swap.lock);
+  }
+  sfence_vma();
+
+  for(i = 0; i < nout; i++){
+    swapio((char*)out[i].pa, out[i].slot, 1);
+    acquire(&swap.lock);
+    swap.busy[out[i].slot] = 0;
+    swap.st.swapouts++;
+    release(&swap.lock);
+    // not under swap.lock: wakeup() takes every p->lock, and the
+    // scan above and fork() take swap.lock with a p->lock held.
+    wakeup(&swap.busy[out[i].slot]);
+    kfree((void*)out[i].pa);
+  }
+  acquire(&swap.lock);
+  swap.st.drops += ndrop;
+  release(&swap.lock);
+  return nout + ndrop;
+}
+
+// kalloc() for callers that may sleep: if memory has run out,
+// shrink the buffer cache or reclaim some user pages and try
+// again. Text pages held by the merge table (ksm.c) can't be
+// reclaimed until it lets them go.
+void*
+kallocreclaim(void)
+{
+  void *mem;
+
+  while((mem = kalloc()) == 0)
+    if(bshrink() == 0 && reclaim() == 0 && ksmflush() == 0)
+      return 0;
+  return mem;
+}
+
+// Handle a fault at va on a PTE_SWAP entry: read the page back
+// from its slot and map it again. read is 0 for a store.
+// Returns the physical address, or 0 on failure.
+uint64
+swapin(pagetable_t pagetable, uint64 va, int read)
+{
+  pte_t *pte;
+  uint64 e, flags;
+  char *mem;
+  uint s;
+
+  if((pte = walk(pagetable, va, 0)) == 0 || (*pte & PTE_SWAP) == 0)
+    return 0;
+  if(!read && (*pte & (PTE_W|PTE_COW)) == 0)
+    return 0;
+  if((mem = kallocreclaim()) == 0)
+    return 0;
+  // only this process changes its own non-present PTEs,
+  // so *pte is unchanged even if kallocreclaim() slept.
+  e = *pte;
+  s = PTE2SLOT(e);
+
+  acquire(&swap.lock);
+  while(swap.busy[s])
+    sleep(&swap.busy[s], &swap.lock);
+  release(&swap.lock);
+  swapio(mem, s, 0);
+
+  // the new page is private, so no longer copy-on-write.
+  flags = PTE_FLAGS(e) & ~(PTE_SWAP|PTE_COW);
+  if(e & PTE_COW)
+    flags |= PTE_W;
+  *pte = PA2PTE(mem) | flags | PTE_V;
+  tlbstale(pagetable);
+  swapfree(s);
+  acquire(&swap.lock);
+  swap.st.swapins++;
+  release(&swap.lock);
+  return (uint64)mem;
+}
+
+// PTE_SWAP entry pte is being unmapped.
+void
+swapunmap(pte_t pte)
+{
+  swapfree(PTE2SLOT(pte));
+}
+
+uint64
+sys_swapstat(void)
+{
+  uint64 addr;
+  struct swapstat st;
+
+  argaddr(0, &addr);
+  acquire(&swap.lock);
+  st = swap.st;
+  release(&swap.lock);
+  st.nslots = nslots();
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,8 @@
+// Swap statistics, returned by the swapstat() system call.
+struct swapstat {
+  uint nslots;     // swap slots (pages) on disk
+  uint inuse;      // slots holding a page
+  uint64 swapouts; // pages written to swap
+  uint64 swapins;  // pages read back from swap
+  uint64 drops;    // clean program pages discarded
+};
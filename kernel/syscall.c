@@ -14,8 +14,8 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
-    return -1;
+  // copyin() checks addr: it may be in the heap, the stack
+  // or an mmap() region.
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
   return 0;
@@ -112,6 +112,19 @@ extern uint64 sys_rw_rlock(void);
 extern uint64 sys_rw_runlock(void);
 extern uint64 sys_rw_wlock(void);
 extern uint64 sys_rw_wunlock(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_shmcreate(void);
+extern uint64 sys_swapstat(void);
+extern uint64 sys_ksmstat(void);
+extern uint64 sys_tlbstat(void);
+extern uint64 sys_meminfo(void);
+extern uint64 sys_kpoolstat(void);
+extern uint64 sys_bcachestat(void);
+extern uint64 sys_diskbench(void);
+extern uint64 sys_iosched(void);
+extern uint64 sys_setprio(void);
+extern uint64 sys_logstat(void);
 #ifdef LAB_NET
 extern uint64 sys_bind(void);
 extern uint64 sys_unbind(void);
@@ -155,6 +168,19 @@ static uint64 (*syscalls[])(void) = {
 [SYS_rw_runlock] sys_rw_runlock,
 [SYS_rw_wlock]   sys_rw_wlock,
 [SYS_rw_wunlock] sys_rw_wunlock,
+[SYS_mmap]       sys_mmap,
+[SYS_munmap]     sys_munmap,
+[SYS_shmcreate]  sys_shmcreate,
+[SYS_swapstat]   sys_swapstat,
+[SYS_ksmstat]    sys_ksmstat,
+[SYS_tlbstat]    sys_tlbstat,
+[SYS_meminfo]    sys_meminfo,
+[SYS_kpoolstat]  sys_kpoolstat,
+[SYS_bcachestat] sys_bcachestat,
+[SYS_diskbench]  sys_diskbench,
+[SYS_iosched]    sys_iosched,
+[SYS_setprio]    sys_setprio,
+[SYS_logstat]    sys_logstat,
 #ifdef LAB_NET
 [SYS_bind] sys_bind,
 [SYS_unbind] sys_unbind,
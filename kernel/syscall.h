@@ -43,3 +43,14 @@
 #define SYS_rw_runlock 40
 #define SYS_rw_wlock   41
 #define SYS_rw_wunlock 42
+#define SYS_shmcreate  43
+#define SYS_swapstat   44
+#define SYS_ksmstat    45
+#define SYS_tlbstat    46
+#define SYS_meminfo    47
+#define SYS_kpoolstat  48
+#define SYS_bcachestat 49
+#define SYS_diskbench  50
+#define SYS_iosched    51
+#define SYS_setprio    52
+#define SYS_logstat    53
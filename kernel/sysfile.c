@@ -308,7 +308,7 @@ sys_open(void)
   int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
+  int n, writer;
 
   argint(1, &omode);
   if((n = argstr(0, path, MAXPATH)) < 0)
@@ -341,9 +341,22 @@ sys_open(void)
     return -1;
   }
 
+  // a running program's text is paged in from its file, so
+  // the file can't be written or truncated (see iexecget()).
+  writer = ip->type == T_FILE && ((omode & O_WRONLY) || (omode & O_RDWR));
+  if(ip->type == T_FILE && (writer || (omode & O_TRUNC))){
+    if(iwriteget(ip) < 0){
+      iunlockput(ip);
+      end_op();
+      return -1;
+    }
+  }
+
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
       fileclose(f);
+    if(writer)
+      iwriteput(ip);
     iunlockput(ip);
     end_op();
     return -1;
@@ -362,6 +375,8 @@ sys_open(void)
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
+    if(!writer)
+      iwriteput(ip);
   }
 
   iunlock(ip);
@@ -503,3 +518,20 @@ sys_pipe(void)
   }
   return 0;
 }
+
+uint64
+sys_shmcreate(void)
+{
+  uint64 size;
+  struct file *f;
+  int fd;
+
+  argaddr(0, &size);
+  if(shmalloc(&f, size) < 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
@@ -7,6 +7,7 @@
 #include "proc.h"
 #include "semaphore.h"
 #include "rwlock.h"
+#include "meminfo.h"
 
 // rwlock syscalls
 uint64 sys_rw_init(void){
@@ -90,8 +91,19 @@ sys_sbrk(void)
 
   argint(0, &n);
   addr = myproc()->sz;
-  if(growproc(n) < 0)
-    return -1;
+  if(n < 0){
+    if(growproc(n) < 0)
+      return -1;
+  } else {
+    // Lazily allocate memory for this process: increase its memory
+    // size but don't allocate memory. If the process uses the
+    // memory, vmfault() will allocate it.
+    if(addr + n < addr)
+      return -1;
+    if(addr + n > HEAPTOP)
+      return -1;
+    myproc()->sz += n;
+  }
   return addr;
 }
 
@@ -161,6 +173,25 @@ sys_kill(void)
   return kill(pid);
 }
 
+// set the calling process's priority, 0 (highest) to PRIO_MAX.
+// it isn't on the run queue while it runs, so no lock is needed
+// to keep the queue consistent.
+uint64
+sys_setprio(void)
+{
+  int prio;
+  struct proc *p = myproc();
+
+  argint(0, &prio);
+  if(prio < PRIO_MIN || prio > PRIO_MAX)
+    return -1;
+  acquire(&p->lock);
+  p->prio = prio;
+  p->base_prio = prio;
+  release(&p->lock);
+  return 0;
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 uint64
@@ -173,3 +204,22 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// meminfo(struct meminfo *mi, struct procmem *pm, int n):
+// system-wide page counts into *mi, and up to n processes'
+// memory use into pm[]. Returns the number of processes.
+uint64
+sys_meminfo(void)
+{
+  uint64 miaddr, pmaddr;
+  int n;
+  struct meminfo mi;
+
+  argaddr(0, &miaddr);
+  argaddr(1, &pmaddr);
+  argint(2, &n);
+  kmeminfo(&mi);
+  if(copyout(myproc()->pagetable, miaddr, (char*)&mi, sizeof(mi)) < 0)
+    return -1;
+  return procmeminfo(pmaddr, n);
+}
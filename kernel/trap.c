@@ -57,6 +57,10 @@ usertrap(void)
     intr_on();
     syscall();
 
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            vmfault(p->pagetable, r_stval(), r_scause() != 15) != 0){
+    // page fault on a not-yet-loaded program page, or on a
+    // lazily-allocated or copy-on-write page.
   } else if((which_dev = devintr()) != 0){
     // device interrupt
   } else {
@@ -70,6 +74,7 @@ usertrap(void)
 
   // 时钟中断：做 aging + 抢占检查
   if(which_dev == 2){
+    p->runticks++;
     prio_on_tick();   // aging，只动 runq 里的 RUNNABLE 进程
 
     if(p && p->state == RUNNING){
@@ -96,6 +101,29 @@ usertrap(void)
 }
 
 
+#ifdef LAB_PGTBL
+// Refresh p's usyscall page before returning to user space.
+// seqlock-style: seq is odd during the update, and readers in
+// user space retry until they see the same even seq before
+// and after reading.
+static void
+usyscallupdate(struct proc *p)
+{
+  struct usyscall *u = p->usyscall;
+
+  u->seq++;
+  __sync_synchronize();
+  u->ticks = ticks;
+  u->hartid = cpuid();
+  u->prio = p->prio;
+  u->base_prio = p->base_prio;
+  u->nsched = p->nsched;
+  u->runticks = p->runticks;
+  __sync_synchronize();
+  u->seq++;
+}
+#endif
+
 //
 // return to user space
 //
@@ -132,14 +160,21 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+#ifdef LAB_PGTBL
+  usyscallupdate(p);
+#endif
+
+  // tell trampoline.S the user page table to switch to,
+  // and whether to flush the TLB around switches of satp.
+  int flush;
+  uint64 satp = asidsatp(p, &flush);
+  p->trapframe->tlbflush = flush;
 
   // jump to userret in trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, flush);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -165,9 +200,16 @@ kerneltrap()
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2){
+    if(myproc() != 0)
+      myproc()->runticks++;
     prio_on_tick();
-    if(myproc() != 0 && prio_should_preempt(myproc()->prio))
+    if(myproc() != 0 && prio_should_preempt(myproc()->prio)){
+      // reclaim() leaves the process's pages alone meanwhile,
+      // since the interrupted code may be using one.
+      myproc()->kpreempted = 1;
       yield();
+      myproc()->kpreempted = 0;
+    }
   }
 
   // the yield() may have caused some traps to occur,
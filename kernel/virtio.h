@@ -46,8 +46,14 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two. each request takes three, plus one
+// for each block past the first that it carries (see MAXSEG in
+// param.h), so up to NUM/3 requests can be in flight.
+#define NUM 128
+
+// deepest queue diskbench() will keep, times the blocks
+// it reads at a time.
+#define MAXQD 32
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -61,11 +67,12 @@ struct virtq_desc {
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
-  uint16 flags; // always zero
+  uint16 flags; // VRING_AVAIL_F_NO_INTERRUPT, or zero
   uint16 idx;   // driver will write ring[idx] next
   uint16 ring[NUM]; // descriptor numbers of chain heads
   uint16 unused;
 };
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // device needn't interrupt
 
 // one entry in the "used" ring, with which the
 // device tells the driver about completed requests.
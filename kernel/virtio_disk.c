@@ -12,6 +12,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
@@ -46,10 +47,14 @@ static struct disk {
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
   struct {
-    struct buf *b;
+    struct buf *b[MAXSEG];  // the blocks of the request, in order
+    int n;
     char status;
   } info[NUM];
 
+  uint64 nreq;     // requests started
+  uint64 nblocks;  //   and the blocks they moved
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -196,12 +201,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+allocn_desc(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,27 +216,41 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Start reading or writing the n bufs in b, which must hold
+// consecutive blocks, as one request, and return without waiting
+// for the disk. Any number of requests may be in flight, up to
+// what the ring's NUM descriptors hold; returns -1 if the ring
+// is full. When the disk is done, virtio_disk_intr() passes the
+// bufs to iodone(). Called by the disk scheduler (iosched.c),
+// holding its lock.
+int
+virtio_disk_startv(struct buf **b, int n, int write)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 sector = b[0]->blockno * (BSIZE / 512);
+  int i;
+
+  if(n < 1 || n > MAXSEG)
+    panic("virtio_disk_startv");
+  for(i = 1; i < n; i++)
+    if(b[i]->blockno != b[0]->blockno + i)
+      panic("virtio_disk_startv: not consecutive");
 
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+  // a descriptor for type/reserved/sector, then descriptors for
+  // the data, then one for a 1-byte status result. the device
+  // treats the data descriptors as one buffer, so a request can
+  // gather consecutive blocks from bufs anywhere in memory.
+
+  // allocate the n+2 descriptors.
+  int idx[MAXSEG+2];
+  if(allocn_desc(idx, n+2) < 0){
+    release(&disk.vdisk_lock);
+    return -1;
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -249,24 +267,29 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(i = 0; i < n; i++){
+    disk.desc[idx[i+1]].addr = (uint64) b[i]->data;
+    disk.desc[idx[i+1]].len = BSIZE;
+    if(write)
+      disk.desc[idx[i+1]].flags = 0; // device reads b->data
+    else
+      disk.desc[idx[i+1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[i+1]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i+1]].next = idx[i+2];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
+
+  // record the bufs for virtio_disk_intr().
+  for(i = 0; i < n; i++)
+    disk.info[idx[0]].b[i] = b[i];
+  disk.info[idx[0]].n = n;
+  disk.nreq++;
+  disk.nblocks += n;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -280,15 +303,39 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
-  }
+  release(&disk.vdisk_lock);
+  return 0;
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// Hand the requests the device has finished to iodone().
+// Caller holds vdisk_lock.
+static void
+complete(void)
+{
+  // the device increments disk.used->idx when it
+  // adds an entry to the used ring.
 
-  release(&disk.vdisk_lock);
+  while(disk.used_idx != disk.used->idx){
+    __sync_synchronize();
+    int id = disk.used->ring[disk.used_idx % NUM].id;
+
+    if(disk.info[id].status != 0)
+      panic("virtio_disk_intr status");
+
+    int n = disk.info[id].n;
+    struct buf *b[MAXSEG];
+    for(int i = 0; i < n; i++){
+      b[i] = disk.info[id].b[i];
+      disk.info[id].b[i] = 0;
+    }
+    free_chain(id);
+    disk.used_idx += 1;
+
+    // iodone() may start more requests, which takes vdisk_lock.
+    release(&disk.vdisk_lock);
+    iodone(b, n);
+    acquire(&disk.vdisk_lock);
+  }
 }
 
 void
@@ -306,22 +353,111 @@ virtio_disk_intr()
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
+  complete();
 
-  while(disk.used_idx != disk.used->idx){
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+  release(&disk.vdisk_lock);
+}
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
+// Hand finished requests to iodone() without waiting for an
+// interrupt, for iowait() when it polls.
+void
+virtio_disk_poll(void)
+{
+  acquire(&disk.vdisk_lock);
+  __sync_synchronize();
+  complete();
+  release(&disk.vdisk_lock);
+}
+
+// Ask the device not to interrupt when it finishes a request
+// (on is 1), while some process is polling, or to interrupt
+// again (on is 0). The device may interrupt anyway.
+void
+virtio_disk_nointr(int on)
+{
+  acquire(&disk.vdisk_lock);
+  if(on)
+    disk.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+  else
+    disk.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+  __sync_synchronize();
+  release(&disk.vdisk_lock);
+}
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+// Return the number of requests started since boot, and the
+// number of blocks they moved.
+void
+virtio_disk_stat(uint64 *nreq, uint64 *nblocks)
+{
+  acquire(&disk.vdisk_lock);
+  *nreq = disk.nreq;
+  *nblocks = disk.nblocks;
+  release(&disk.vdisk_lock);
+}
 
-    disk.used_idx += 1;
+// Read n runs of nblk blocks at random places in the file system
+// area with qd requests in flight at a time, to measure the disk's
+// IOPS and latency at that queue depth. Uses buffers of its own,
+// outside the cache, and lets the disk scheduler keep qd requests
+// on the disk. If lat is not 0, stores the latency of each read
+// in microseconds, from being queued to the wait for it returning,
+// in the array of n uints at lat.
+uint64
+sys_diskbench(void)
+{
+  struct buf *b[MAXQD], **r;
+  uint64 t0[MAXQD], lat;
+  int qd, n, nblk, i, j, depth, err = 0, started = 0, done = 0;
+  uint seed = 1, blockno, us;
+
+  argint(0, &qd);
+  argint(1, &n);
+  argint(2, &nblk);
+  argaddr(3, &lat);
+  if(qd < 1 || n < 0 || nblk < 1 || nblk > MAXSEG || qd * nblk > MAXQD)
+    return -1;
+  for(i = 0; i < qd * nblk; i++){
+    if((b[i] = (struct buf*)kalloc()) == 0){
+      while(--i >= 0)
+        kfree(b[i]);
+      return -1;
+    }
+    memset(b[i], 0, sizeof(struct buf));
+    b[i]->dev = ROOTDEV;
   }
 
-  release(&disk.vdisk_lock);
+  depth = iosetdepth(qd);
+
+  // keep every run of buffers busy until n reads have been
+  // started, waiting for them in the order they were started.
+  for(i = 0; done < n; i = (i + 1) % qd){
+    r = &b[i * nblk];
+    if(r[0]->valid){
+      for(j = 0; j < nblk; j++)
+        iowait(r[j]);
+      us = (r_time() - t0[i]) / 10;
+      if(lat && copyout(myproc()->pagetable, lat + done * sizeof(us),
+                        (char *)&us, sizeof(us)) < 0){
+        lat = 0;
+        err = -1;
+      }
+      r[0]->valid = 0;
+      done++;
+    }
+    if(started < n){
+      seed = seed * 1103515245 + 12345;
+      blockno = (seed >> 8) % (FSSIZE - nblk + 1);
+      for(j = 0; j < nblk; j++)
+        r[j]->blockno = blockno + j;
+      r[0]->valid = 1;   // a read is in flight
+      t0[i] = r_time();
+      iostartv(r, nblk, 0);
+      started++;
+    }
+  }
+
+  iosetdepth(depth);
+  for(i = 0; i < qd * nblk; i++)
+    kfree(b[i]);
+  return err;
 }
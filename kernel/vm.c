@@ -7,6 +7,8 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
+#include "meminfo.h"
+#include "kpool.h"
 
 /*
  * the kernel's page table.
@@ -23,7 +25,7 @@ kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
+  kpgtbl = (pagetable_t) kallocpool(KPOOL_PGTBL);
   memset(kpgtbl, 0, PGSIZE);
 
   // uart registers
@@ -74,12 +76,32 @@ kvminithart()
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
+  // the kernel runs with ASID 0 (see asid.c).
   w_satp(MAKE_SATP(kernel_pagetable));
 
   // flush stale entries from the TLB.
   sfence_vma();
 }
 
+// Allocate a zeroed page-table page for a user page table,
+// from the current process's cache of them if it has one.
+static pagetable_t
+ptalloc(void)
+{
+  struct proc *p = myproc();
+  pagetable_t pt;
+
+  if(p && (pt = p->ptcache) != 0){
+    p->ptcache = (pagetable_t)pt[0];
+    p->nptcache--;
+    pt[0] = 0;
+    return pt;
+  }
+  if((pt = (pagetable_t)kallocpool(KPOOL_PGTBL)) != 0)
+    memset(pt, 0, PGSIZE);
+  return pt;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -108,9 +130,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
       }
 #endif
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = ptalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
@@ -141,14 +162,92 @@ walkaddr(pagetable_t pagetable, uint64 va)
 }
 
 
-// add a mapping to the kernel page table.
-// only used when booting.
+// Return the address of the PTE at the given level (2, 1 or 0)
+// of pagetable for va, creating the page-table pages above it
+// if alloc != 0. Returns 0 if a page-table page is missing and
+// alloc is 0, or can't be allocated.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int level, int alloc)
+{
+  pte_t *pte;
+
+  for(int l = 2; l > level; l--) {
+    pte = &pagetable[PX(l, va)];
+    if(*pte & PTE_V) {
+      if(*pte & (PTE_R|PTE_W|PTE_X))
+        panic("walklevel: superpage");
+      pagetable = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kallocpool(KPOOL_PGTBL)) == 0)
+        return 0;
+      memset(pagetable, 0, PGSIZE);
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+  return &pagetable[PX(level, va)];
+}
+
+// add a mapping to the kernel page table, with 1 GiB and
+// 2 MiB superpages wherever va, pa and the size allow, so
+// that the direct map takes few page-table pages and TLB
+// entries. only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 end = va + sz, lsz;
+  pte_t *pte;
+  int level;
+
+  if((va % PGSIZE) != 0 || (sz % PGSIZE) != 0 || sz == 0)
+    panic("kvmmap: not aligned");
+
+  while(va < end){
+    // the largest leaf that fits.
+    for(level = 2; level > 0; level--){
+      lsz = 1L << PXSHIFT(level);
+      if(va % lsz == 0 && pa % lsz == 0 && end - va >= lsz)
+        break;
+    }
+    lsz = 1L << PXSHIFT(level);
+    if((pte = walklevel(kpgtbl, va, level, 1)) == 0)
+      panic("kvmmap");
+    if(*pte & PTE_V)
+      panic("kvmmap: remap");
+    *pte = PA2PTE(pa) | perm | PTE_V;
+    va += lsz;
+    pa += lsz;
+  }
+}
+
+// Count the page-table pages of pagetable, whose top is at the
+// given level, into *npages and its leaf PTEs at each level
+// into nleaf[].
+static void
+vmcount(pagetable_t pagetable, int level, int *npages, int nleaf[3])
+{
+  (*npages)++;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) == 0)
+      continue;
+    if(level > 0 && (pte & (PTE_R|PTE_W|PTE_X)) == 0)
+      vmcount((pagetable_t)PTE2PA(pte), level - 1, npages, nleaf);
+    else
+      nleaf[level]++;
+  }
+}
+
+// Print the size of pagetable: its page-table pages and
+// how many 1 GiB, 2 MiB and 4 KiB pages it maps.
+void
+vmsummary(char *name, pagetable_t pagetable)
+{
+  int npages = 0, nleaf[3] = { 0, 0, 0 };
+
+  vmcount(pagetable, 2, &npages, nleaf);
+  printf("%s: %d page-table pages, %d 1G + %d 2M + %d 4K mappings\n",
+         name, npages, nleaf[2], nleaf[1], nleaf[0]);
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -184,11 +283,41 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
     a += PGSIZE;
     pa += PGSIZE;
   }
+  tlbstale(pagetable);
   return 0;
 }
 
+// Pages to be given to kfreevec() together, so that tearing
+// down a page table takes the allocator's locks once per
+// NFREEBATCH pages rather than once per page.
+#define NFREEBATCH 32
+
+struct freebatch {
+  int n;
+  void *pa[NFREEBATCH];
+};
+
+static void
+batchfree(struct freebatch *b, void *pa)
+{
+  b->pa[b->n++] = pa;
+  if(b->n == NFREEBATCH){
+    kfreevec(b->pa, b->n);
+    b->n = 0;
+  }
+}
+
+static void
+batchflush(struct freebatch *b)
+{
+  if(b->n > 0)
+    kfreevec(b->pa, b->n);
+  b->n = 0;
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never mapped (see vmfault)
+// are skipped, and pages out in swap give up their slot.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -196,26 +325,35 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   uint64 a;
   pte_t *pte;
   int sz;
+  struct freebatch b;
+
+  b.n = 0;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += sz){
     sz = PGSIZE;
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0) {
-      printf("va=%ld pte=%ld\n", a, *pte);
-      panic("uvmunmap: not mapped");
+    if((pte = walk(pagetable, a, 0)) == 0){
+      // no level-0 page: nothing mapped up to the next one.
+      sz = (a | ((1L << PXSHIFT(1)) - 1)) + 1 - a;
+      continue;
+    }
+    if((*pte & PTE_V) == 0){
+      if(*pte & PTE_SWAP){
+        swapunmap(*pte);
+        *pte = 0;
+      }
+      continue;
     }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
-    }
+    if(do_free)
+      batchfree(&b, (void*)PTE2PA(*pte));
     *pte = 0;
   }
+  batchflush(&b);
+  tlbstale(pagetable);
 }
 
 // create an empty user page table.
@@ -223,12 +361,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 pagetable_t
 uvmcreate()
 {
-  pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
-  if(pagetable == 0)
-    return 0;
-  memset(pagetable, 0, PGSIZE);
-  return pagetable;
+  return ptalloc();
 }
 
 // Load the user initcode into address 0 of pagetable,
@@ -248,31 +381,29 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 }
 
 
-// Allocate PTEs and physical memory to grow process from oldsz to
-// newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Allocate PTEs to grow process from oldsz to newsz, which need
+// not be page aligned.  Returns new size or 0 on error.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
-  char *mem;
-  uint64 a;
-  int sz;
+  uint64 a, pa;
+  int sz, perm;
 
   if(newsz < oldsz)
     return oldsz;
 
+  // every new page maps the zero page, copy-on-write,
+  // until it is first written (see ksm.c).
+  perm = PTE_R|PTE_U|xperm;
+  if(perm & PTE_W)
+    perm = (perm & ~PTE_W) | PTE_COW;
+
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += sz){
     sz = PGSIZE;
-    mem = kalloc();
-    if(mem == 0){
-      uvmdealloc(pagetable, a, oldsz);
-      return 0;
-    }
-#ifndef LAB_SYSCALL
-    memset(mem, 0, sz);
-#endif
-    if(mappages(pagetable, a, sz, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
-      kfree(mem);
+    pa = zeropage();
+    if(mappages(pagetable, a, sz, pa, perm) != 0){
+      kfree((void*)pa);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
@@ -298,10 +429,12 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   return newsz;
 }
 
-// Recursively free page-table pages.
-// All leaf mappings must already have been removed.
-void
-freewalk(pagetable_t pagetable)
+// Recursively free the page-table pages below pagetable,
+// clearing their PTEs, then pagetable itself: into the current
+// process's cache while it holds fewer than NPTCACHE, since
+// they are zeroed now, otherwise into b.
+static void
+freewalkbatch(pagetable_t pagetable, struct proc *p, struct freebatch *b)
 {
   // there are 2^9 = 512 PTEs in a page table.
   for(int i = 0; i < 512; i++){
@@ -309,13 +442,58 @@ freewalk(pagetable_t pagetable)
     if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
       // this PTE points to a lower-level page table.
       uint64 child = PTE2PA(pte);
-      freewalk((pagetable_t)child);
-      pagetable[i] = 0;
+      freewalkbatch((pagetable_t)child, p, b);
     } else if(pte & PTE_V){
       panic("freewalk: leaf");
     }
+    pagetable[i] = 0;
+  }
+  if(p && p->nptcache < NPTCACHE){
+    pagetable[0] = (pte_t)p->ptcache;
+    p->ptcache = pagetable;
+    p->nptcache++;
+  } else {
+    batchfree(b, pagetable);
   }
-  kfree((void*)pagetable);
+}
+
+// Recursively free page-table pages.
+// All leaf mappings must already have been removed.
+void
+freewalk(pagetable_t pagetable)
+{
+  struct freebatch b;
+
+  b.n = 0;
+  freewalkbatch(pagetable, myproc(), &b);
+  batchflush(&b);
+}
+
+// Free the page-table pages p keeps for reuse, when p is freed.
+void
+ptcachefree(struct proc *p)
+{
+  struct freebatch b;
+  pagetable_t pt;
+
+  b.n = 0;
+  while((pt = p->ptcache) != 0){
+    p->ptcache = (pagetable_t)pt[0];
+    batchfree(&b, pt);
+  }
+  p->nptcache = 0;
+  batchflush(&b);
+}
+
+// Move the top level-2 entry, under which proc_pagetable()
+// maps the trampoline, trapframe and usyscall pages, from old
+// to new, so that exec() needn't build those levels again.
+// Any mmap() pages there must have been unmapped.
+void
+uvmmovetop(pagetable_t old, pagetable_t new)
+{
+  new[PX(2, TRAMPOLINE)] = old[PX(2, TRAMPOLINE)];
+  old[PX(2, TRAMPOLINE)] = 0;
 }
 
 // Free user memory pages,
@@ -330,54 +508,304 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// The physical pages are not copied: the child maps the
+// same pages, and writable pages are made read-only and
+// marked PTE_COW in both page tables, so that the first
+// store by either process makes a private copy (see cowfault).
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  return uvmcopyrange(old, new, 0, sz, 0);
+}
+
+// Like uvmcopy(), for the pages mapped in [start, end).
+// If shared is set, writable pages stay writable in both
+// page tables, for MAP_SHARED regions. Pages out in swap
+// are shared by giving the child a reference to the slot.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int shared)
+{
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
-  int szinc;
 
-  for(i = 0; i < sz; i += szinc){
-    szinc = PGSIZE;
-    szinc = PGSIZE;
+  for(i = start; i < end; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;   // page table page hasn't been allocated
+    if((*pte & PTE_V) == 0){
+      if((*pte & PTE_SWAP) == 0)
+        continue;   // physical page hasn't been allocated
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      *npte = *pte;
+      swapdup(*pte);
+      continue;
+    }
+    if(!shared && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    krefinc((void*)pa);
   }
+  tlbstale(old);
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  tlbstale(old);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
-// mark a PTE invalid for user access.
-// used by exec for the user stack guard page.
+// Resolve a store to the copy-on-write page at va, by
+// giving the page table a private, writable copy of the page.
+// If no other page table shares the page any more, it is
+// simply made writable again.
+// returns 0 on success, -1 if va is not a copy-on-write
+// page or there is no memory for the copy.
+int
+cowfault(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_COW) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    tlbstale(pagetable);
+    return 0;
+  }
+
+  // kallocreclaim() may sleep in reclaim(), which could swap
+  // the page out and free it if the other sharers went away
+  // meanwhile; a reference of our own keeps it shared.
+  krefinc((void*)pa);
+  if((mem = kallocreclaim()) == 0){
+    kfree((void*)pa);
+    return -1;
+  }
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  tlbstale(pagetable);
+  kfree((void*)pa);   // our reference
+  kfree((void*)pa);   // the PTE's
+  return 0;
+}
+
+// Handle a page fault by the current process at va.
+// Regions created by mmap() are paged in by vmafault().
+// exec() maps none of the program, so the first touch of each
+// program page arrives here and is read from the program file.
+// sys_sbrk() grows the process without allocating memory, and
+// the stack grows down from USTACKTOP unallocated, so the first
+// touch of each heap or stack page arrives here: a load maps
+// the shared zero page, a store gets a freshly zeroed page.
+// A store to a copy-on-write page (including the zero
+// page) gets a private copy, and a page that reclaim() wrote
+// out is read back from swap.
+// returns the physical address of the page, or 0 if va
+// is not a valid address or there is no memory.
+uint64
+vmfault(pagetable_t pagetable, uint64 va, int read)
+{
+  struct proc *p = myproc();
+  struct execseg *seg;
+  struct vma *v = 0;
+  pte_t *pte;
+  char *mem;
+
+  if(va >= p->sz && (va < USTACKLIM || va >= USTACKTOP) &&
+     (v = vmalookup(p, va)) == 0)
+    return 0;
+  va = PGROUNDDOWN(va);
+
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    if(read || (*pte & PTE_COW) == 0)
+      return 0;
+    if(cowfault(pagetable, va) < 0)
+      return 0;
+    return PTE2PA(*pte);
+  }
+  if(pte && (*pte & PTE_SWAP))
+    return swapin(pagetable, va, read);
+
+  if(v)
+    return vmafault(pagetable, v, va, read);
+
+  if((seg = execseg(p, va)) != 0){
+    if(!read && (seg->perm & PTE_W) == 0)
+      return 0;
+    return execload(pagetable, p->execip, seg, va, read);
+  }
+
+  // the stack grows down as it is touched.
+  if(va >= USTACKLIM && va < USTACKTOP && va < p->stackbase)
+    p->stackbase = va;
+
+  if(read){
+    // not written yet: map the zero page.
+    mem = (char*)zeropage();
+    if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_U|PTE_COW) != 0){
+      kfree(mem);
+      return 0;
+    }
+    return (uint64)mem;
+  }
+  if((mem = kallocreclaim()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return 0;
+  }
+  return (uint64)mem;
+}
+
+// Fault in the current process's pages of [va, va+len), writable
+// if write, for a copy to or from them to be made while holding
+// an inode lock. That copy must not fault: paging in program text
+// or an mmap()ed file takes another inode's lock, and two
+// processes doing that in opposite orders would deadlock. Keeps
+// reclaim() away from the process's pages until uvmunpin().
+// Returns how many bytes from va are now present, which is less
+// than len if some page can't be faulted in.
+uint64
+uvmpin(uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  uint64 a;
+  pte_t *pte;
+
+  acquire(&p->lock);
+  p->pinned = 1;
+  release(&p->lock);
+  if(va + len < va || va + len > MAXVA)
+    return 0;
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    if(pte && (*pte & PTE_V) && (!write || (*pte & PTE_COW) == 0))
+      continue;
+    if(vmfault(p->pagetable, a, !write) == 0)
+      return a > va ? a - va : 0;
+  }
+  return len;
+}
+
+// Let reclaim() have the current process's pages again.
 void
-uvmclear(pagetable_t pagetable, uint64 va)
+uvmunpin(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+  p->pinned = 0;
+  release(&p->lock);
+}
+
+// walk() for copyout(), copyin() and copyinstr(), which go
+// through user buffers page by page: remember the level-0
+// page-table page of the current process's page table that
+// the last walk ended in, and go straight to it while the
+// addresses stay in the 2 MiB it maps. Other page tables
+// (exec() copying out to the new one) get a plain walk().
+static pte_t *
+uwalk(pagetable_t pagetable, uint64 va)
 {
+  struct proc *p = myproc();
+  struct walkcache *wc;
   pte_t *pte;
-  
-  pte = walk(pagetable, va, 0);
-  if(pte == 0)
-    panic("uvmclear");
-  *pte &= ~PTE_U;
+
+  if(va >= MAXVA)
+    return 0;
+  if(p == 0 || p->pagetable != pagetable)
+    return walk(pagetable, va, 0);
+  wc = &p->wc;
+  if(wc->l0 && wc->tag == va >> PXSHIFT(1))
+    return &wc->l0[PX(0, va)];
+
+  pte = walklevel(pagetable, va, 1, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0)
+    return 0;
+  if(*pte & (PTE_R|PTE_W|PTE_X))
+    return pte;   // a superpage
+  wc->l0 = (pagetable_t)PTE2PA(*pte);
+  wc->tag = va >> PXSHIFT(1);
+  return &wc->l0[PX(0, va)];
+}
+
+// Like walkaddr(), through uwalk().
+static uint64
+uwalkaddr(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+
+  if((pte = uwalk(pagetable, va)) == 0)
+    return 0;
+  if((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+    return 0;
+  return PTE2PA(*pte);
+}
+
+// Count the pages of p's page table pt, which maps the addresses
+// from va up at the given level, into pm.
+static void
+uvmstatwalk(struct proc *p, pagetable_t pt, int level, uint64 va, struct procmem *pm)
+{
+  struct execseg *s;
+  uint64 a, n;
+  pte_t pte;
+
+  pm->pagetable++;
+  for(int i = 0; i < 512; i++){
+    pte = pt[i];
+    a = va | ((uint64)i << PXSHIFT(level));
+    if((pte & PTE_V) == 0){
+      if(pte & PTE_SWAP)
+        pm->swapped++;
+      continue;
+    }
+    if(level > 0 && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
+      uvmstatwalk(p, (pagetable_t)PTE2PA(pte), level - 1, a, pm);
+      continue;
+    }
+    if((pte & PTE_U) == 0)
+      continue;   // trampoline, trapframe, stack guard
+    n = 1L << (9*level);
+    if(a >= p->stackbase && a < USTACKTOP)
+      pm->stack += n;
+    else if(a >= p->sz)
+      pm->mmap += n;
+    else if((s = execseg(p, a)) != 0 && (s->perm & PTE_W))
+      pm->data += n;
+    else if(s)
+      pm->text += n;
+    else
+      pm->heap += n;
+    if(krefcnt((void*)PTE2PA(pte)) > 1)
+      pm->shared += n;
+  }
+}
+
+// Fill in the user memory counts of pm for p, whose
+// lock must be held.
+void
+uvmstat(struct proc *p, struct procmem *pm)
+{
+  uvmstatwalk(p, p->pagetable, 2, 0, pm);
 }
 
 // Copy from kernel to user.
@@ -393,19 +821,28 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
     va0 = PGROUNDDOWN(dstva);
     if (va0 >= MAXVA)
       return -1;
-    if((pte = walk(pagetable, va0, 0)) == 0) {
-      // printf("copyout: pte should exist 0x%x %d\n", dstva, len);
-      return -1;
+    pte = uwalk(pagetable, va0);
+    if(pte == 0 || (*pte & PTE_V) == 0){
+      // not allocated yet.
+      if(vmfault(pagetable, va0, 0) == 0)
+        return -1;
+      pte = uwalk(pagetable, va0);
+    } else if(*pte & PTE_COW){
+      // still shared copy-on-write. Not through vmfault(),
+      // since exec() copies out to a page table that isn't
+      // the current process's yet.
+      if(cowfault(pagetable, va0) < 0)
+        return -1;
     }
 
-
     // forbid copyout over read-only user text pages.
-    if((*pte & PTE_W) == 0)
-      return -1;
-    
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((*pte & PTE_W) == 0 || (*pte & PTE_U) == 0)
       return -1;
+
+    // the hardware only sets PTE_D for user stores; set it
+    // here too, so that a dirty MAP_SHARED page is written back.
+    *pte |= PTE_D;
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -428,9 +865,11 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    pa0 = uwalkaddr(pagetable, va0);
+    if(pa0 == 0){
+      if((pa0 = vmfault(pagetable, va0, 1)) == 0)
+        return -1;
+    }
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
@@ -455,9 +894,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
+    pa0 = uwalkaddr(pagetable, va0);
+    if(pa0 == 0){
+      if((pa0 = vmfault(pagetable, va0, 1)) == 0)
+        return -1;
+    }
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
@@ -0,0 +1,107 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/bcache.h"
+#include "user/user.h"
+
+//
+// Buffer cache lock traffic with several processes reading.
+//
+// NCHILD processes each write a file of NBLOCK blocks and then
+// read it NROUND times, concurrently. Reports the cache's hits
+// and misses, and how often the bucket locks and the lock that
+// misses take were acquired and had to be waited for.
+//
+
+#define NCHILD 4
+#define NBLOCK 20
+#define NROUND 10
+
+static void
+fail(char *what)
+{
+  printf("bcachebench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+child(int n)
+{
+  char name[] = "bct0", buf[BSIZE];
+  int fd;
+
+  name[3] = '0' + n;
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+    fail("create");
+  memset(buf, n, sizeof(buf));
+  for(int i = 0; i < NBLOCK; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+
+  for(int r = 0; r < NROUND; r++){
+    if((fd = open(name, O_RDONLY)) < 0)
+      fail("open");
+    for(int i = 0; i < NBLOCK; i++){
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+        fail("read");
+      if(buf[0] != n || buf[BSIZE-1] != n)
+        fail("data check");
+    }
+    close(fd);
+  }
+  unlink(name);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat before, after;
+  uint64 n, nts, tn = 0, tnts = 0, maxn = 0, maxnts = 0;
+  int start, xstatus, busiest = 0;
+
+  if(bcachestat(&before, 0, -1, -1, -1) < 0)
+    fail("bcachestat");
+  start = uptime();
+  for(int i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0)
+      child(i);
+  }
+  for(int i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      fail("child");
+  }
+  printf("bcachebench: %d processes x %d reads of %d blocks in %d ticks\n",
+         NCHILD, NROUND, NBLOCK, uptime() - start);
+  bcachestat(&after, 0, -1, -1, -1);
+
+  printf("bcachebench: %d buffers in %d buckets: %d hits, %d misses\n",
+         after.nbuf, after.nbucket, (int)(after.hits - before.hits),
+         (int)(after.misses - before.misses));
+  for(int i = 0; i < after.nbucket; i++){
+    n = after.nacquire[i] - before.nacquire[i];
+    nts = after.ncontend[i] - before.ncontend[i];
+    tn += n;
+    tnts += nts;
+    if(n > maxn){
+      maxn = n;
+      maxnts = nts;
+      busiest = i;
+    }
+  }
+  printf("bcachebench: bucket locks: %d acquires, %d contended spins; "
+         "busiest bucket %d: %d acquires, %d contended spins\n",
+         (int)tn, (int)tnts, busiest, (int)maxn, (int)maxnts);
+  printf("bcachebench: miss lock: %d acquires, %d contended spins\n",
+         (int)(after.nacquire[after.nbucket] - before.nacquire[after.nbucket]),
+         (int)(after.ncontend[after.nbucket] - before.ncontend[after.nbucket]));
+  printf("bcachebench: OK\n");
+  exit(0);
+}
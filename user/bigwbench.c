@@ -0,0 +1,85 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/log.h"
+#include "user/user.h"
+
+//
+// Throughput of large write()s with small and large transactions.
+//
+// Writes 1 MiB and then 16 MiB, FILEKB KiB at a time: each chunk
+// is one write() of a new file, which is removed again, since a
+// file can't be bigger than MAXFILE blocks and the disk holds
+// only a few MiB. Runs once with write() split into transactions
+// of MAXOPBLOCKS blocks, as before the log was sized by mkfs, and
+// once with transactions as big as a log region allows. Reports
+// the ticks and the commits each took.
+//
+
+#define FILEKB 256
+
+static char *buf;
+
+static void
+fail(char *what)
+{
+  printf("bigwbench: %s failed\n", what);
+  exit(1);
+}
+
+// Write mb MiB; return the ticks taken.
+static int
+run(int mb)
+{
+  int fd, i, t = uptime();
+
+  for(i = 0; i < mb * 1024 / FILEKB; i++){
+    if((fd = open("bigwfile", O_CREATE | O_WRONLY)) < 0)
+      fail("create");
+    if(write(fd, buf, FILEKB * 1024) != FILEKB * 1024)
+      fail("write");
+    close(fd);
+    if(unlink("bigwfile") < 0)
+      fail("unlink");
+  }
+  return uptime() - t;
+}
+
+static void
+bench(int maxop, int mb)
+{
+  struct logstat before, after;
+  int t, ncommit;
+
+  if(logstat(&before, -1, -1, maxop) < 0)
+    fail("logstat");
+  t = run(mb);
+  logstat(&after, -1, -1, -1);
+  ncommit = after.commits - before.commits;
+  printf("bigwbench: %d MiB, transactions of %d blocks: %d ticks, "
+         "%d commits of %d blocks, %d us each\n", mb, before.maxop, t,
+         ncommit, (int)(after.blocks - before.blocks),
+         (int)((after.commitus - before.commitus) / (ncommit ? ncommit : 1)));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct logstat orig;
+
+  if(logstat(&orig, -1, -1, -1) < 0)
+    fail("logstat");
+  printf("bigwbench: log of %d regions of %d blocks\n",
+         orig.nregion, orig.nblock);
+  if((buf = malloc(FILEKB * 1024)) == 0)
+    fail("malloc");
+  memset(buf, 'b', FILEKB * 1024);
+  bench(MAXOPBLOCKS, 1);
+  bench(orig.nblock, 1);
+  bench(MAXOPBLOCKS, 16);
+  bench(orig.nblock, 16);
+  logstat(&orig, -1, -1, orig.maxop);
+  printf("bigwbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,140 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/kpool.h"
+#include "user/user.h"
+
+//
+// Context switches and page walks with kallocpool()'s page
+// coloring off and on.
+//
+// For each setting, a fresh child (so that its trapframe and
+// page tables are allocated under that setting) forks a partner
+// and bounces a byte between them over two pipes NSWITCH times.
+// Then it grows its heap to NREGION regions of 2 MiB, each with
+// its own level-0 page-table page, and reads one word from each
+// region NWALK times, with a system call after each sweep so
+// that the TLB has to be refilled from the page tables.
+//
+// QEMU does not model the caches, so the two settings should run
+// at the same speed there; the difference shows on hardware.
+//
+
+#define NSWITCH 5000
+#define NREGION 64
+#define REGION  (2*1024*1024)
+#define NWALK   2000
+
+static void
+fail(char *what)
+{
+  printf("colorbench: %s failed\n", what);
+  exit(1);
+}
+
+static int
+pingpong(void)
+{
+  int a[2], b[2], pid, start, t;
+  char c = 0;
+
+  if(pipe(a) < 0 || pipe(b) < 0)
+    fail("pipe");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    for(int i = 0; i < NSWITCH; i++){
+      if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+        fail("partner");
+    }
+    exit(0);
+  }
+  start = uptime();
+  for(int i = 0; i < NSWITCH; i++){
+    if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1)
+      fail("ping");
+  }
+  t = uptime() - start;
+  wait(0);
+  close(a[0]); close(a[1]); close(b[0]); close(b[1]);
+  return t;
+}
+
+static int
+walks(void)
+{
+  char *mem, *p;
+  int start, t;
+  uint sum = 0;
+
+  mem = sbrk(NREGION * REGION);
+  if(mem == (char*)-1)
+    fail("sbrk");
+  // region i starts in the i'th 2 MiB block at or above mem.
+  p = (char*)(((uint64)mem + REGION - 1) & ~(uint64)(REGION - 1));
+  start = uptime();
+  for(int i = 0; i < NWALK; i++){
+    for(int j = 0; j < NREGION - 1; j++)
+      sum += p[(uint64)j * REGION];
+    getpid();
+  }
+  t = uptime() - start;
+  if(sum != 0)
+    fail("zero page check");
+  sbrk(-(NREGION * REGION));
+  return t;
+}
+
+static void
+run(int on)
+{
+  struct kpoolstat before, after;
+  int pid, fd[2], t[2];
+
+  if(kpoolstat(&before, on) < 0)
+    fail("kpoolstat");
+  if(pipe(fd) < 0)
+    fail("pipe");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    t[0] = pingpong();
+    t[1] = walks();
+    write(fd[1], t, sizeof(t));
+    exit(0);
+  }
+  close(fd[1]);
+  if(read(fd[0], t, sizeof(t)) != sizeof(t))
+    fail("run");
+  close(fd[0]);
+  wait(0);
+  kpoolstat(&after, -1);
+
+  printf("colorbench: coloring %s: %d switches in %d ticks, "
+         "%d walks in %d ticks\n", on ? "on " : "off",
+         2*NSWITCH, t[0], NWALK * (NREGION - 1), t[1]);
+  printf("colorbench:   page-table pages %d (%d off color), "
+         "trapframes %d (%d off color)\n",
+         (int)(after.allocs[KPOOL_PGTBL] - before.allocs[KPOOL_PGTBL]),
+         (int)(after.misses[KPOOL_PGTBL] - before.misses[KPOOL_PGTBL]),
+         (int)(after.allocs[KPOOL_TRAPFRAME] - before.allocs[KPOOL_TRAPFRAME]),
+         (int)(after.misses[KPOOL_TRAPFRAME] - before.misses[KPOOL_TRAPFRAME]));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct kpoolstat st;
+
+  if(kpoolstat(&st, -1) < 0)
+    fail("kpoolstat");
+  printf("colorbench: %d page colors\n", st.ncolor);
+  run(0);
+  run(1);
+  kpoolstat(&st, st.on);
+  printf("colorbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,76 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+//
+// Fork latency of a large parent.
+//
+// The parent grows itself to 64 MiB and touches every page,
+// then forks children that either exit at once (the usual
+// fork-then-exec pattern) or write a few pages first.
+// With copy-on-write fork both cases should cost about the
+// same as forking a small process; with an eager uvmcopy()
+// the 64 MiB parent cannot even be forked in 128 MiB of RAM.
+//
+
+#define PARENTSZ (64*1024*1024)
+#define NFORK    50
+
+static char *heap;
+
+// fork NFORK children, each writing ntouch pages of the
+// parent's heap before exiting. returns elapsed ticks.
+static int
+forkloop(int ntouch)
+{
+  int start = uptime();
+
+  for(int i = 0; i < NFORK; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("cowbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(int j = 0; j < ntouch; j++)
+        heap[j * PGSIZE] = j;
+      exit(0);
+    }
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("cowbench: child failed\n");
+      exit(1);
+    }
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  heap = sbrk(PARENTSZ);
+  if(heap == (char*)-1){
+    printf("cowbench: sbrk(%d) failed\n", PARENTSZ);
+    exit(1);
+  }
+  for(int i = 0; i < PARENTSZ; i += PGSIZE)
+    heap[i] = 1;
+
+  printf("cowbench: parent %d MiB, %d forks per run\n",
+         PARENTSZ / (1024*1024), NFORK);
+  printf("cowbench: fork+exit          %d ticks\n", forkloop(0));
+  printf("cowbench: fork+touch 1 page  %d ticks\n", forkloop(1));
+  printf("cowbench: fork+touch 64 pages %d ticks\n", forkloop(64));
+
+  // the parent's pages must be intact after all that sharing.
+  for(int i = 0; i < PARENTSZ; i += PGSIZE){
+    if(heap[i] != 1){
+      printf("cowbench: parent page %d corrupted\n", i / PGSIZE);
+      exit(1);
+    }
+  }
+  printf("cowbench: OK\n");
+  exit(0);
+}
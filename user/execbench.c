@@ -0,0 +1,69 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+//
+// exec latency of a large program.
+//
+// This program carries IMAGESZ bytes of initialized data, so
+// its own binary is big. It re-execs itself with an argument
+// that makes the new image either exit at once or first touch
+// every page of the data. With demand-paged exec the first case
+// costs about the same as exec'ing a tiny program, since only
+// the pages actually used are read from the file.
+//
+
+#define IMAGESZ (192*1024)
+#define NEXEC   50
+
+char image[IMAGESZ] = { 1 };
+
+// fork+exec+wait NEXEC copies of ourselves with argument arg.
+// returns elapsed ticks.
+static int
+execloop(char *self, char *arg)
+{
+  char *argv[] = { self, arg, 0 };
+  int start = uptime();
+
+  for(int i = 0; i < NEXEC; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("execbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(self, argv);
+      printf("execbench: exec %s failed\n", self);
+      exit(1);
+    }
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("execbench: child failed\n");
+      exit(1);
+    }
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1 && strcmp(argv[1], "exit") == 0)
+    exit(0);
+  if(argc > 1 && strcmp(argv[1], "touch") == 0){
+    int sum = 0;
+    for(int i = 0; i < IMAGESZ; i += PGSIZE)
+      sum += image[i];
+    exit(sum == 1 ? 0 : 1);
+  }
+
+  printf("execbench: %d KiB image, %d execs per run\n",
+         IMAGESZ / 1024, NEXEC);
+  printf("execbench: exec+exit        %d ticks\n", execloop(argv[0], "exit"));
+  printf("execbench: exec+touch all   %d ticks\n", execloop(argv[0], "touch"));
+  printf("execbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,60 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/kpool.h"
+#include "user/user.h"
+
+//
+// fork()+exec()+exit() loops per second.
+//
+// Forks NLOOP children one after another; each execs this
+// program with the argument "x", which exits at once, and the
+// parent waits for it. Reports the rate and how many page-table
+// pages had to come from the allocator rather than from the
+// processes' caches of them.
+//
+
+#define NLOOP 500
+
+int
+main(int argc, char *argv[])
+{
+  struct kpoolstat before, after;
+  char *xargv[] = { "forkexec", "x", 0 };
+  int pid, xstatus, start, t;
+
+  if(argc > 1)
+    exit(0);
+
+  if(kpoolstat(&before, -1) < 0){
+    printf("forkexec: kpoolstat failed\n");
+    exit(1);
+  }
+  start = uptime();
+  for(int i = 0; i < NLOOP; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("forkexec: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(xargv[0], xargv);
+      printf("forkexec: exec failed\n");
+      exit(1);
+    }
+    if(wait(&xstatus) != pid || xstatus != 0){
+      printf("forkexec: child failed\n");
+      exit(1);
+    }
+  }
+  t = uptime() - start;
+  kpoolstat(&after, -1);
+
+  printf("forkexec: %d fork+exec+exit in %d ticks, %d per 100 ticks\n",
+         NLOOP, t, NLOOP * 100 / (t ? t : 1));
+  printf("forkexec: %d page-table pages from the allocator, %d per loop\n",
+         (int)(after.allocs[KPOOL_PGTBL] - before.allocs[KPOOL_PGTBL]),
+         (int)(after.allocs[KPOOL_PGTBL] - before.allocs[KPOOL_PGTBL]) / NLOOP);
+  printf("forkexec: OK\n");
+  exit(0);
+}
@@ -0,0 +1,80 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/meminfo.h"
+#include "user/user.h"
+
+//
+// free: report free and used memory, pages allocated and freed
+// by each hart, and each process's memory use in pages.
+//
+
+static struct meminfo mi;
+static struct procmem pm[NPROC];
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+static char *states[] = {
+  "unused", "used", "sleep", "runble", "run", "zombie"
+};
+
+// print n right-aligned in w columns.
+static void
+col(uint64 n, int w)
+{
+  char buf[24];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + n % 10;
+    n /= 10;
+  } while(n && i > 0);
+  while(i > 0 && (int)sizeof(buf) - 1 - i < w)
+    buf[--i] = ' ';
+  printf("%s", buf + i);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  if((n = meminfo(&mi, pm, NPROC)) < 0){
+    printf("free: meminfo failed\n");
+    exit(1);
+  }
+
+  printf("        pages      KiB\n");
+  printf("total");
+  col(mi.npages, 8); col(mi.npages * 4, 9); printf("\n");
+  printf("used ");
+  col(mi.npages - mi.nfree, 8); col((mi.npages - mi.nfree) * 4, 9); printf("\n");
+  printf("free ");
+  col(mi.nfree, 8); col(mi.nfree * 4, 9); printf("\n");
+
+  printf("\nhart     alloc     free\n");
+  for(int i = 0; i < NCPU; i++){
+    if(mi.nalloc[i] == 0 && mi.nfreed[i] == 0)
+      continue;
+    col(i, 4); col(mi.nalloc[i], 10); col(mi.nfreed[i], 9); printf("\n");
+  }
+
+  printf("\n pid name            state  text data stack  heap  mmap shared swap  pt kern\n");
+  for(int i = 0; i < n; i++){
+    struct procmem *m = &pm[i];
+    char *st = m->state >= 0 && m->state < NELEM(states) ? states[m->state] : "???";
+    col(m->pid, 4);
+    printf(" %s", m->name);
+    for(int j = strlen(m->name); j < 16; j++)
+      printf(" ");
+    printf("%s", st);
+    for(int j = strlen(st); j < 6; j++)
+      printf(" ");
+    col(m->text, 5); col(m->data, 5); col(m->stack, 6); col(m->heap, 6);
+    col(m->mmap, 6); col(m->shared, 7); col(m->swapped, 5);
+    col(m->pagetable, 4); col(m->kernel, 5);
+    printf("\n");
+  }
+  exit(0);
+}
@@ -0,0 +1,32 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+//
+// Random-read IOPS of the virtio disk at several queue depths.
+//
+// For each depth, asks the kernel (diskbench()) to read NREAD
+// random blocks while keeping that many requests in flight.
+//
+
+#define NREAD 4000
+
+int
+main(int argc, char *argv[])
+{
+  int depth[] = { 1, 4, 16, 32 };
+  int start, t;
+
+  for(int i = 0; i < sizeof(depth)/sizeof(depth[0]); i++){
+    start = uptime();
+    if(diskbench(depth[i], NREAD, 1, 0) < 0){
+      printf("iopsbench: diskbench failed\n");
+      exit(1);
+    }
+    t = uptime() - start;
+    printf("iopsbench: queue depth %d: %d reads in %d ticks, %d per 100 ticks\n",
+           depth[i], NREAD, t, NREAD * 100 / (t ? t : 1));
+  }
+  printf("iopsbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,151 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/bcache.h"
+#include "kernel/iosched.h"
+#include "user/user.h"
+
+//
+// Disk latency under each scheduling policy.
+//
+// For each policy, empties the buffer cache and runs NREADER
+// processes that each read a file of NBLK blocks, while another
+// process rewrites a file of its own, so that reads, read-ahead
+// and log writes compete for the disk. The first reader runs at
+// a high priority, the rest at a low one. Reports how long the
+// first reader and the others took, and histograms of read and
+// write latency.
+//
+
+#define NREADER 3
+#define NBLK    64
+#define NWRITE  8     // passes over the writer's file
+
+static char buf[BSIZE];
+static char *policyname[NIOPOLICY] = { "noop", "deadline", "prio" };
+
+static void
+fail(char *what)
+{
+  printf("iosbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+name(char *s, int i)
+{
+  strcpy(s, "iosb0");
+  s[4] = '0' + i;
+}
+
+static void
+mkfile(char *s)
+{
+  int fd;
+
+  if((fd = open(s, O_CREATE|O_WRONLY)) < 0)
+    fail("create");
+  for(int i = 0; i < NBLK; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+}
+
+// Read (or, for the writer, rewrite) file i, and exit with the
+// number of ticks it took.
+static void
+child(int i)
+{
+  char s[8];
+  int fd, n, t = uptime();
+
+  name(s, i);
+  if(i == NREADER){
+    setprio(PRIO_DEFAULT);
+    for(n = 0; n < NWRITE; n++)
+      mkfile(s);
+  } else {
+    setprio(i == 0 ? PRIO_MIN : PRIO_MAX - 1);
+    if((fd = open(s, O_RDONLY)) < 0)
+      fail("open");
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+      ;
+    close(fd);
+  }
+  exit(uptime() - t);
+}
+
+static void
+hist(char *what, uint64 *before, uint64 *after)
+{
+  printf("  %s:", what);
+  for(int h = 0; h < NIOHIST; h++)
+    if(after[h] != before[h])
+      printf(" %s%dus %d", h == NIOHIST-1 ? ">=" : "<",
+             1 << (h == NIOHIST-1 ? h-1 : h), (int)(after[h] - before[h]));
+  printf("\n");
+}
+
+static void
+run(struct bcachestat *orig, int policy)
+{
+  struct bcachestat st;
+  struct iostat before, after;
+  int pid[NREADER+1], i, p, xstatus, hi = 0, lo = 0;
+
+  if(iosched(&before, policy, -1, -1) < 0)
+    fail("iosched");
+  bcachestat(&st, 1, -1, -1, -1);
+  bcachestat(&st, orig->maxbuf, -1, -1, -1);
+  for(i = 0; i <= NREADER; i++){
+    if((pid[i] = fork()) < 0)
+      fail("fork");
+    if(pid[i] == 0)
+      child(i);
+  }
+  for(i = 0; i <= NREADER; i++){
+    if((p = wait(&xstatus)) < 0)
+      fail("wait");
+    if(p == pid[0])
+      hi = xstatus;
+    else if(p != pid[NREADER])
+      lo += xstatus;
+  }
+  iosched(&after, -1, -1, -1);
+  printf("iosbench: %s: high-priority reader %d ticks, others %d ticks "
+         "on average; %d requests, %d blocks, %d expired\n",
+         policyname[policy], hi, lo / (NREADER - 1),
+         (int)(after.nreq[policy] - before.nreq[policy]),
+         (int)(after.nblocks[policy] - before.nblocks[policy]),
+         (int)(after.nexpired[policy] - before.nexpired[policy]));
+  hist("reads", before.hist[policy][0], after.hist[policy][0]);
+  hist("writes", before.hist[policy][1], after.hist[policy][1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat orig;
+  struct iostat st;
+  char s[8];
+
+  if(bcachestat(&orig, 0, -1, -1, -1) < 0 || iosched(&st, -1, -1, -1) < 0)
+    fail("stat");
+  for(int i = 0; i <= NREADER; i++){
+    name(s, i);
+    mkfile(s);
+  }
+
+  for(int p = 0; p < NIOPOLICY; p++)
+    run(&orig, p);
+
+  iosched(&st, st.policy, -1, -1);
+  for(int i = 0; i <= NREADER; i++){
+    name(s, i);
+    unlink(s);
+  }
+  printf("iosbench: OK\n");
+  exit(0);
+}
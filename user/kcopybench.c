@@ -0,0 +1,63 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+//
+// Kernel copy throughput: read() a small file, which stays in
+// the buffer cache, over and over. Each read copies the file
+// from the buffer cache through the kernel's direct map of RAM,
+// so its speed depends on how many TLB entries that map needs.
+// The boot messages report the size of the kernel page table.
+//
+
+#define FILESZ  (16*1024)
+#define NREAD   4000
+
+static char *name = "kcopybench.tmp";
+static char buf[FILESZ];
+
+static void
+fail(char *what)
+{
+  printf("kcopybench: %s failed\n", what);
+  unlink(name);
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, start, t;
+
+  memset(buf, 'k', sizeof(buf));
+  if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    fail("create");
+  if(write(fd, buf, FILESZ) != FILESZ)
+    fail("write");
+  close(fd);
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    fail("open");
+  start = uptime();
+  for(int i = 0; i < NREAD; i++){
+    if(read(fd, buf, FILESZ) != FILESZ)
+      fail("read");
+    if(buf[0] != 'k' || buf[FILESZ-1] != 'k')
+      fail("data check");
+    // no lseek(): start over by opening the file again.
+    close(fd);
+    if((fd = open(name, O_RDONLY)) < 0)
+      fail("open");
+  }
+  t = uptime() - start;
+  close(fd);
+  unlink(name);
+
+  printf("kcopybench: %d KiB in %d ticks", NREAD * (FILESZ / 1024), t);
+  if(t > 0)
+    printf(", %d KiB/tick", NREAD * (FILESZ / 1024) / t);
+  printf("\n");
+  printf("kcopybench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,81 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/ksm.h"
+#include "user/user.h"
+
+//
+// Resident memory of NSH concurrent shells.
+//
+// Starts NSH copies of sh, all reading commands from one pipe,
+// waits for them to block, and reports how many pages they use
+// and how many more they would use if text pages and untouched
+// zero pages weren't shared. Closing the pipe makes them exit.
+//
+
+#define NSH 50
+
+static void
+fail(char *what)
+{
+  printf("ksmbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+stats(struct ksmstat *st)
+{
+  if(ksmstat(st) < 0)
+    fail("ksmstat");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int in[2], err[2], pid, used;
+  char *shargv[] = { "sh", 0 };
+  struct ksmstat before, after;
+
+  // sh prints its prompt on fd 2; send it to a pipe nobody reads.
+  if(pipe(in) < 0 || pipe(err) < 0)
+    fail("pipe");
+  stats(&before);
+
+  for(int i = 0; i < NSH; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      close(0);
+      dup(in[0]);
+      close(2);
+      dup(err[1]);
+      close(in[0]);
+      close(in[1]);
+      close(err[0]);
+      close(err[1]);
+      exec("sh", shargv);
+      fail("exec sh");
+    }
+  }
+  close(in[0]);
+  close(err[1]);
+  sleep(20);   // let every sh block reading the pipe
+
+  stats(&after);
+  used = before.freepages - after.freepages;
+  printf("ksmbench: %d sh: %d pages resident, %d per sh\n",
+         NSH, used, used / NSH);
+  printf("ksmbench: sharing saves %d pages (%d KiB): %d zero page maps, "
+         "%d text pages merged\n", (int)after.saved, (int)after.saved * 4,
+         (int)after.zeromaps, (int)(after.merges - before.merges));
+  printf("ksmbench: without sharing: %d pages, %d per sh\n",
+         used + (int)after.saved, (used + (int)after.saved) / NSH);
+
+  close(in[1]);
+  for(int i = 0; i < NSH; i++)
+    if(wait(0) < 0)
+      fail("wait");
+  close(err[0]);
+  printf("ksmbench: OK\n");
+  exit(0);
+}
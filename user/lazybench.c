@@ -0,0 +1,64 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+//
+// Cost of reserving a big heap and touching little of it.
+//
+// sbrk() only moves the break; pages are allocated and zeroed
+// on first touch. Reserving 1 GiB (far more than physical
+// memory) and touching 1% of it should therefore cost about
+// as much as allocating that 1% up front.
+//
+
+#define RESERVE  (1024*1024*1024)
+#define NROUNDS  10
+
+int
+main(int argc, char *argv[])
+{
+  int npages = RESERVE / PGSIZE;
+  int ntouch = npages / 100;
+  int t0, t1, t2, t3;
+  int sbrkticks = 0, touchticks = 0, freeticks = 0;
+
+  printf("lazybench: sbrk(%d MiB), touch %d of %d pages, %d rounds\n",
+         RESERVE / (1024*1024), ntouch, npages, NROUNDS);
+
+  for(int r = 0; r < NROUNDS; r++){
+    t0 = uptime();
+    char *a = sbrk(RESERVE);
+    t1 = uptime();
+    if(a == (char*)-1){
+      printf("lazybench: sbrk failed\n");
+      exit(1);
+    }
+
+    // touch every 100th page, spread over the whole reservation.
+    for(int i = 0; i < ntouch; i++)
+      a[(uint64)i * 100 * PGSIZE] = i;
+    for(int i = 0; i < ntouch; i++){
+      if(a[(uint64)i * 100 * PGSIZE] != (char)i){
+        printf("lazybench: bad value at page %d\n", i * 100);
+        exit(1);
+      }
+    }
+    t2 = uptime();
+
+    if(sbrk(-RESERVE) == (char*)-1){
+      printf("lazybench: sbrk shrink failed\n");
+      exit(1);
+    }
+    t3 = uptime();
+
+    sbrkticks += t1 - t0;
+    touchticks += t2 - t1;
+    freeticks += t3 - t2;
+  }
+
+  printf("lazybench: sbrk %d ticks, touch %d ticks, release %d ticks\n",
+         sbrkticks, touchticks, freeticks);
+  printf("lazybench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,141 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/log.h"
+#include "user/user.h"
+
+//
+// File system throughput with and without pipelined log commits
+// and asynchronous installs.
+//
+// Runs two workloads: stressfs's (NCHILD processes each write and
+// read back a file of 20 512-byte writes) repeated NSTRESS times,
+// and NCHILD processes each creating, writing and removing NSMALL
+// small files. They run first with new transactions waiting for
+// the whole commit of the last one, then with them filling the
+// log's next region while it commits, and then also with end_op()
+// leaving the install to the flusher thread. Reports end_op()'s
+// average commit latency for each.
+//
+
+#define NCHILD  4
+#define NSTRESS 10
+#define NSMALL  50
+
+static char data[512];
+
+static void
+fail(char *what)
+{
+  printf("logbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+stress(int c)
+{
+  char path[] = "lbstress0";
+  int fd, i, j;
+
+  path[8] += c;
+  for(j = 0; j < NSTRESS; j++){
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0)
+      fail("create");
+    for(i = 0; i < 20; i++)
+      if(write(fd, data, sizeof(data)) != sizeof(data))
+        fail("write");
+    close(fd);
+    if((fd = open(path, O_RDONLY)) < 0)
+      fail("open");
+    for(i = 0; i < 20; i++)
+      read(fd, data, sizeof(data));
+    close(fd);
+  }
+  unlink(path);
+}
+
+static void
+small(int c)
+{
+  char path[] = "lbsmall00";
+  int fd, i;
+
+  path[7] += c;
+  for(i = 0; i < NSMALL; i++){
+    path[8] = '0' + i % 10;
+    if((fd = open(path, O_CREATE | O_WRONLY)) < 0)
+      fail("create");
+    if(write(fd, data, 100) != 100)
+      fail("write");
+    close(fd);
+    if(unlink(path) < 0)
+      fail("unlink");
+  }
+}
+
+// Run f in NCHILD processes at once; return the ticks taken.
+static int
+run(void (*f)(int))
+{
+  int t = uptime();
+
+  for(int c = 0; c < NCHILD; c++){
+    int pid = fork();
+    if(pid < 0)
+      fail("fork");
+    if(pid == 0){
+      f(c);
+      exit(0);
+    }
+  }
+  for(int c = 0; c < NCHILD; c++){
+    int xstatus;
+    if(wait(&xstatus) < 0 || xstatus != 0)
+      fail("child");
+  }
+  return uptime() - t;
+}
+
+static void
+bench(int pipeline, int async)
+{
+  struct logstat before, after;
+  int ts, tc, ncommit;
+
+  if(logstat(&before, pipeline, async, -1) < 0)
+    fail("logstat");
+  ts = run(stress);
+  tc = run(small);
+  logstat(&after, -1, -1, -1);
+  ncommit = after.commits - before.commits;
+  printf("logbench: pipeline %d async %d: stressfs x %d in %d ticks, "
+         "%d small files in %d ticks\n", pipeline, async, NSTRESS, ts,
+         NCHILD * NSMALL, tc);
+  printf("logbench:   %d ops, %d commits of %d blocks, %d us each; "
+         "%d blocks installed, %d absorbed\n",
+         (int)(after.ops - before.ops), ncommit,
+         (int)(after.blocks - before.blocks),
+         (int)((after.commitus - before.commitus) / (ncommit ? ncommit : 1)),
+         (int)(after.installblocks - before.installblocks),
+         (int)(after.absorbed - before.absorbed));
+  printf("logbench:   waits: %d for commit, %d for space, %d for a region\n",
+         (int)(after.commitwaits - before.commitwaits),
+         (int)(after.spacewaits - before.spacewaits),
+         (int)(after.regionwaits - before.regionwaits));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct logstat orig;
+
+  memset(data, 'a', sizeof(data));
+  if(logstat(&orig, -1, -1, -1) < 0)
+    fail("logstat");
+  bench(0, 0);
+  bench(1, 0);
+  bench(1, 1);
+  logstat(&orig, orig.pipeline, orig.async, -1);
+  printf("logbench: OK\n");
+  exit(0);
+}
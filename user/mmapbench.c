@@ -0,0 +1,153 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+//
+// Reading a file through read() versus mmap().
+//
+// Scans a FILESZ file NPASS times with read() into a buffer
+// and then through a MAP_PRIVATE mapping, and does NLOOKUP
+// random lookups through the mapping. Then checks that stores
+// to a MAP_SHARED mapping reach the file, stores to a
+// MAP_PRIVATE one don't, and that an anonymous MAP_SHARED
+// region is shared with a child.
+//
+
+#define FILESZ  (256*1024)
+#define NPASS   20
+#define NLOOKUP 200000
+
+static char *name = "mmapbench.tmp";
+static char buf[PGSIZE];
+
+static void
+fail(char *what)
+{
+  printf("mmapbench: %s failed\n", what);
+  unlink(name);
+  exit(1);
+}
+
+static uint
+pattern(uint i)
+{
+  return (i * 7 + i / 251) & 0xff;
+}
+
+static uint
+readsum(void)
+{
+  uint sum = 0;
+  int fd, n;
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    fail("open");
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    for(int i = 0; i < n; i++)
+      sum += (uchar)buf[i];
+  close(fd);
+  return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, start, t;
+  uint sum, want = 0;
+  char *p;
+
+  if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    fail("create");
+  for(int off = 0; off < FILESZ; off += PGSIZE){
+    for(int i = 0; i < PGSIZE; i++){
+      buf[i] = pattern(off + i);
+      want += (uchar)buf[i];
+    }
+    if(write(fd, buf, PGSIZE) != PGSIZE)
+      fail("write");
+  }
+  close(fd);
+
+  printf("mmapbench: %d KiB file, %d passes, %d lookups\n",
+         FILESZ / 1024, NPASS, NLOOKUP);
+
+  start = uptime();
+  for(int i = 0; i < NPASS; i++)
+    if(readsum() != want)
+      fail("read() scan");
+  printf("mmapbench: read() scan      %d ticks\n", uptime() - start);
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    fail("open");
+  start = uptime();
+  p = mmap(0, FILESZ, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap");
+  close(fd);
+  for(int i = 0; i < NPASS; i++){
+    sum = 0;
+    for(int j = 0; j < FILESZ; j++)
+      sum += (uchar)p[j];
+    if(sum != want)
+      fail("mmap() scan");
+  }
+  printf("mmapbench: mmap() scan      %d ticks\n", uptime() - start);
+
+  start = uptime();
+  uint x = 1;
+  for(int i = 0; i < NLOOKUP; i++){
+    x = x * 1103515245 + 12345;
+    uint off = (x >> 8) % FILESZ;
+    if((uchar)p[off] != pattern(off))
+      fail("mmap() lookup");
+  }
+  printf("mmapbench: mmap() lookups   %d ticks\n", uptime() - start);
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap");
+
+  // MAP_SHARED stores are written back on munmap().
+  if((fd = open(name, O_RDWR)) < 0)
+    fail("open");
+  p = mmap(0, FILESZ, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap shared");
+  for(int off = 0; off < FILESZ; off += PGSIZE){
+    want += (uchar)(pattern(off) + 1) - (uchar)p[off];
+    p[off] = pattern(off) + 1;
+  }
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap shared");
+
+  // MAP_PRIVATE stores are not.
+  p = mmap(0, FILESZ, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap private");
+  for(int off = 0; off < FILESZ; off += PGSIZE)
+    p[off] = 0;
+  if(munmap(p, FILESZ) < 0)
+    fail("munmap private");
+  close(fd);
+  if(readsum() != want)
+    fail("write-back");
+
+  // anonymous MAP_SHARED memory is shared with children.
+  p = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1)
+    fail("mmap anonymous");
+  t = fork();
+  if(t < 0)
+    fail("fork");
+  if(t == 0){
+    p[0] = 'c';
+    exit(0);
+  }
+  wait(0);
+  if(p[0] != 'c')
+    fail("shared anonymous");
+
+  unlink(name);
+  printf("mmapbench: OK\n");
+  exit(0);
+}
@@ -9,6 +9,7 @@
 void print_pgtbl();
 void print_kpgtbl();
 void ugetpid_test();
+void usyscall_test();
 void superpg_test();
 
 int
@@ -16,6 +17,7 @@ main(int argc, char *argv[])
 {
   print_pgtbl();
   ugetpid_test();
+  usyscall_test();
   print_kpgtbl();
   superpg_test();
   printf("pgtbltest: all tests succeeded\n");
@@ -75,6 +77,26 @@ ugetpid_test()
   printf("ugetpid_test: OK\n");
 }
 
+void
+usyscall_test()
+{
+  int t0, t1, u;
+
+  printf("usyscall_test starting\n");
+  testname = "usyscall_test";
+
+  t0 = uptime();
+  u = uuptime();
+  t1 = uptime();
+  if (u < t0 || u > t1)
+    err("uuptime out of range");
+  if (ugethartid() < 0 || ugethartid() >= NCPU)
+    err("bad hartid");
+  if (ugetprio() < 0 || ugetprio() >= NPRIO)
+    err("bad prio");
+  printf("usyscall_test: OK\n");
+}
+
 void
 print_kpgtbl()
 {
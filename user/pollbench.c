@@ -0,0 +1,73 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
+#include "kernel/iosched.h"
+#include "user/user.h"
+
+//
+// Latency of synchronous 4 KiB disk reads, with completions
+// delivered by interrupt and by polling.
+//
+// Asks the kernel (diskbench()) for NREAD random reads of 4 KiB,
+// one at a time, first with polling off, then with iowait()
+// polling for up to POLLUS microseconds before it sleeps, and
+// reports the median and 99th percentile latency of each.
+//
+
+#define NREAD  500
+#define POLLUS 1000
+
+static uint lat[NREAD];
+
+static void
+fail(char *what)
+{
+  printf("pollbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+sort(uint *a, int n)
+{
+  uint x;
+  int i, j;
+
+  for(i = 1; i < n; i++){
+    x = a[i];
+    for(j = i; j > 0 && a[j-1] > x; j--)
+      a[j] = a[j-1];
+    a[j] = x;
+  }
+}
+
+static void
+run(int poll)
+{
+  struct iostat before, after;
+
+  if(iosched(&before, -1, -1, poll) < 0)
+    fail("iosched");
+  if(diskbench(1, NREAD, 4096 / BSIZE, lat) < 0)
+    fail("diskbench");
+  iosched(&after, -1, -1, -1);
+  sort(lat, NREAD);
+  printf("pollbench: poll %d us: p50 %d us, p99 %d us; "
+         "%d waits polled, %d slept\n", poll,
+         lat[NREAD / 2], lat[NREAD * 99 / 100],
+         (int)(after.npolled - before.npolled),
+         (int)(after.nslept - before.nslept));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iostat orig;
+
+  if(iosched(&orig, -1, -1, -1) < 0)
+    fail("iosched");
+  run(0);
+  run(POLLUS);
+  iosched(&orig, -1, -1, orig.poll);
+  printf("pollbench: OK\n");
+  exit(0);
+}
@@ -1,5 +1,6 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
 #include "user/user.h"
 
 #define NBUF 5          // 缓冲区大小
@@ -11,19 +12,25 @@
 #define SEM_FULL  1
 #define SEM_MUTEX 2
 
-int buffer[NBUF];
-int in = 0, out = 0;
+// 缓冲区放在共享内存段里，fork 出的生产者和消费者看到的是同一份，
+// 信号量保护的才是真正共享的数据（普通全局变量 fork 后各自一份）
+struct ring {
+  int buffer[NBUF];
+  int in, out;
+};
 
-// 模拟向缓冲区放数据
+struct ring *ring;
+
+// 向缓冲区放数据
 void put(int x) {
-  buffer[in] = x;
-  in = (in + 1) % NBUF;
+  ring->buffer[ring->in] = x;
+  ring->in = (ring->in + 1) % NBUF;
 }
 
-// 模拟从缓冲区取数据
+// 从缓冲区取数据
 int get(void) {
-  int x = buffer[out];
-  out = (out + 1) % NBUF;
+  int x = ring->buffer[ring->out];
+  ring->out = (ring->out + 1) % NBUF;
   return x;
 }
 
@@ -62,6 +69,19 @@ main(void)
 {
   printf("=== Producer-Consumer test ===\n");
 
+  // 创建共享内存段并映射，子进程 fork 时继承该映射
+  int fd = shmcreate(sizeof(struct ring));
+  if (fd < 0) {
+    printf("shmcreate failed\n");
+    exit(1);
+  }
+  ring = mmap(0, sizeof(struct ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ring == (struct ring *)-1) {
+    printf("mmap failed\n");
+    exit(1);
+  }
+
   sem_init(SEM_EMPTY, NBUF); // 初始空位=缓冲区大小
   sem_init(SEM_FULL,  0);    // 初始满位=0
   sem_init(SEM_MUTEX, 1);    // 互斥锁=1
@@ -0,0 +1,109 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/bcache.h"
+#include "user/user.h"
+
+//
+// cat of a large file, with and without read-ahead.
+//
+// Writes a file of MAXFILE blocks, the largest xv6 allows, then
+// NPASS times empties the buffer cache and runs cat on the file,
+// with its output going to a pipe that this program drains.
+// Reports the time with readi()'s read-ahead off and on, and how
+// many blocks were read ahead and used.
+//
+
+#define NPASS 8
+
+static char buf[BSIZE];
+
+static void
+fail(char *what)
+{
+  printf("rabench: %s failed\n", what);
+  exit(1);
+}
+
+// Run cat on the file; return the number of bytes it wrote.
+static int
+cat(void)
+{
+  char *argv[] = { "cat", "rabig", 0 };
+  int fd[2], pid, n, tot = 0, xstatus;
+
+  if(pipe(fd) < 0)
+    fail("pipe");
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    close(1);
+    dup(fd[1]);
+    close(fd[0]);
+    close(fd[1]);
+    exec("cat", argv);
+    fail("exec cat");
+  }
+  close(fd[1]);
+  while((n = read(fd[0], buf, sizeof(buf))) > 0)
+    tot += n;
+  close(fd[0]);
+  if(wait(&xstatus) != pid || xstatus != 0)
+    fail("cat");
+  return tot;
+}
+
+static void
+run(struct bcachestat *orig, int ramax)
+{
+  struct bcachestat st, before, after;
+  int t = 0, start;
+
+  bcachestat(&before, 0, -1, ramax, -1);
+  for(int i = 0; i < NPASS; i++){
+    // evict the file's blocks, then let the cache grow again.
+    bcachestat(&st, 1, -1, -1, -1);
+    bcachestat(&st, orig->maxbuf, -1, -1, -1);
+    start = uptime();
+    if(cat() != MAXFILE * BSIZE)
+      fail("size check");
+    t += uptime() - start;
+  }
+  bcachestat(&after, 0, -1, -1, -1);
+  printf("rabench: read-ahead %d: %d x %d KiB in %d ticks; %d misses, "
+         "%d read ahead, %d used, %d wasted\n",
+         ramax, NPASS, (int)(MAXFILE * BSIZE / 1024), t,
+         (int)(after.misses - before.misses),
+         (int)(after.rastarts - before.rastarts),
+         (int)(after.rahits - before.rahits),
+         (int)(after.rawasted - before.rawasted));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat orig;
+  int fd;
+
+  if(bcachestat(&orig, 0, -1, -1, -1) < 0)
+    fail("bcachestat");
+  if((fd = open("rabig", O_CREATE|O_WRONLY)) < 0)
+    fail("create");
+  for(int i = 0; i < MAXFILE; i++){
+    memset(buf, i, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  }
+  close(fd);
+
+  run(&orig, 0);
+  run(&orig, orig.ramax ? orig.ramax : RAMAX);
+
+  bcachestat(&orig, orig.maxbuf, -1, orig.ramax, -1);
+  unlink("rabig");
+  printf("rabench: OK\n");
+  exit(0);
+}
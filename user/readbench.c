@@ -0,0 +1,62 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+//
+// read() throughput: NPASS passes, in CHUNK-byte reads, over a
+// file of FILESZ bytes (files can't reach 1 MiB). Every block
+// read copies BSIZE bytes out to the user buffer, which walks
+// the user page table for the destination page.
+//
+
+#define FILESZ  (256*1024)
+#define CHUNK   (64*1024)
+#define NPASS   16
+
+static char *name = "readbench.tmp";
+static char buf[CHUNK];
+
+static void
+fail(char *what)
+{
+  printf("readbench: %s failed\n", what);
+  unlink(name);
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, start, t, n;
+
+  memset(buf, 'r', sizeof(buf));
+  if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    fail("create");
+  for(int off = 0; off < FILESZ; off += CHUNK)
+    if(write(fd, buf, CHUNK) != CHUNK)
+      fail("write");
+  close(fd);
+
+  start = uptime();
+  for(int pass = 0; pass < NPASS; pass++){
+    if((fd = open(name, O_RDONLY)) < 0)
+      fail("open");
+    for(int off = 0; off < FILESZ; off += n){
+      if((n = read(fd, buf, CHUNK)) <= 0)
+        fail("read");
+      if(buf[0] != 'r' || buf[n-1] != 'r')
+        fail("data check");
+    }
+    close(fd);
+  }
+  t = uptime() - start;
+  unlink(name);
+
+  printf("readbench: %d MiB in %d ticks", NPASS * FILESZ / (1024*1024), t);
+  if(t > 0)
+    printf(", %d KiB/tick", NPASS * (FILESZ / 1024) / t);
+  printf("\n");
+  printf("readbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,129 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/bcache.h"
+#include "user/user.h"
+
+//
+// Scan resistance of the buffer cache.
+//
+// Shrinks the cache to NCACHE buffers, then NROUND times reads
+// NHOT small files (the blocks a program uses over and over)
+// and streams through a file of NBIG blocks, more than the whole
+// cache, twice. Reports how many of the hot blocks missed after
+// each stream, with plain CLOCK replacement and with 2Q, which
+// should keep the hot blocks once it has seen them come back.
+// Restores the cache's size and policy at the end.
+//
+
+#define NCACHE 150
+#define NHOT   40
+#define NBIG   250
+#define NROUND 4
+
+static char buf[BSIZE];
+
+static void
+fail(char *what)
+{
+  printf("scanbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+hotname(char *name, int i)
+{
+  strcpy(name, "sbh00");
+  name[3] = '0' + i / 10;
+  name[4] = '0' + i % 10;
+}
+
+static void
+readfile(char *name, int n)
+{
+  int fd;
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    fail("open");
+  for(int i = 0; i < n; i++)
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("read");
+  close(fd);
+}
+
+static void
+writefile(char *name, int n)
+{
+  int fd;
+
+  if((fd = open(name, O_CREATE|O_WRONLY)) < 0)
+    fail("create");
+  for(int i = 0; i < n; i++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+}
+
+static void
+hotpass(void)
+{
+  char name[8];
+
+  for(int i = 0; i < NHOT; i++){
+    hotname(name, i);
+    readfile(name, 1);
+  }
+}
+
+static void
+run(int twoq)
+{
+  struct bcachestat st, before, after;
+
+  if(bcachestat(&st, NCACHE, twoq, -1, -1) < 0)
+    fail("bcachestat");
+  printf("scanbench: %s, %d buffers:", twoq ? "2Q   " : "CLOCK", st.nbuf);
+  bcachestat(&before, 0, -1, -1, -1);
+  hotpass();
+  for(int r = 0; r < NROUND; r++){
+    readfile("sbbig", NBIG);
+    readfile("sbbig", NBIG);
+    bcachestat(&st, 0, -1, -1, -1);
+    hotpass();
+    bcachestat(&after, 0, -1, -1, -1);
+    printf(" %d", (int)(after.misses - st.misses));
+  }
+  printf(" hot misses; hit rate %d%%, %d ghost hits\n",
+         (int)((after.hits - before.hits) * 100 /
+               (after.hits - before.hits + after.misses - before.misses)),
+         (int)(after.ghosthits - before.ghosthits));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat orig;
+  char name[8];
+
+  if(bcachestat(&orig, 0, -1, -1, -1) < 0)
+    fail("bcachestat");
+  for(int i = 0; i < NHOT; i++){
+    hotname(name, i);
+    writefile(name, 1);
+  }
+  writefile("sbbig", NBIG);
+
+  run(0);
+  run(1);
+
+  bcachestat(&orig, orig.maxbuf, orig.twoq, -1, -1);
+  for(int i = 0; i < NHOT; i++){
+    hotname(name, i);
+    unlink(name);
+  }
+  unlink("sbbig");
+  printf("scanbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,83 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "kernel/bcache.h"
+#include "user/user.h"
+
+//
+// Large sequential writes, with and without merged disk requests.
+//
+// NPASS times overwrites a file of NBLK blocks with writes of
+// CHUNK blocks, so that each transaction logs a run of
+// consecutive blocks. Every block is written twice, to the log
+// and then home, by the log's commit(). Reports the
+// time with the disk scheduler limited to one block per request, and
+// with MAXSEG, along with the disk requests and blocks per request.
+//
+
+#define NBLK  256
+#define CHUNK 8
+#define NPASS 4
+
+static char buf[CHUNK*BSIZE];
+
+static void
+fail(char *what)
+{
+  printf("sgbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+run(int maxseg)
+{
+  struct bcachestat before, after;
+  int fd, t, nreq, nblk;
+
+  bcachestat(&before, 0, -1, -1, maxseg);
+  t = uptime();
+  for(int i = 0; i < NPASS; i++){
+    if((fd = open("sgbig", O_WRONLY)) < 0)
+      fail("open");
+    for(int j = 0; j < NBLK / CHUNK; j++){
+      memset(buf, i + j, sizeof(buf));
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+        fail("write");
+    }
+    close(fd);
+  }
+  t = uptime() - t;
+  bcachestat(&after, 0, -1, -1, -1);
+  nreq = after.nreq - before.nreq;
+  nblk = after.nreqblocks - before.nreqblocks;
+  printf("sgbench: maxseg %d: %d x %d KiB in %d ticks; %d requests, "
+         "%d blocks, %d.%d blocks per request\n",
+         maxseg, NPASS, NBLK * BSIZE / 1024, t, nreq, nblk,
+         nblk / (nreq ? nreq : 1), nblk * 10 / (nreq ? nreq : 1) % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bcachestat orig;
+  int fd;
+
+  if(bcachestat(&orig, 0, -1, -1, -1) < 0)
+    fail("bcachestat");
+  if((fd = open("sgbig", O_CREATE|O_WRONLY)) < 0)
+    fail("create");
+  for(int j = 0; j < NBLK / CHUNK; j++)
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+      fail("write");
+  close(fd);
+
+  run(1);
+  run(MAXSEG);
+
+  bcachestat(&orig, 0, -1, -1, orig.maxseg);
+  unlink("sgbig");
+  printf("sgbench: OK\n");
+  exit(0);
+}
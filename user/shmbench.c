@@ -0,0 +1,126 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+//
+// Producer/consumer throughput: a pipe versus a ring of
+// buffers in a shared memory segment.
+//
+// A child produces NCHUNK chunks of CHUNK bytes and the
+// parent consumes them. Through the pipe every chunk is
+// copied into the kernel and out again; through the ring
+// the consumer reads the producer's stores in place, and
+// the semaphore syscalls only pass slot ownership along.
+//
+
+#define CHUNK   4096
+#define NCHUNK  2048
+#define NSLOT   8
+
+// semaphore ids, clear of the ones prodcons uses.
+#define SEM_EMPTY 20
+#define SEM_FULL  21
+
+static char buf[CHUNK];
+
+static void
+fail(char *what)
+{
+  printf("shmbench: %s failed\n", what);
+  exit(1);
+}
+
+static void
+produce(char *p, int i)
+{
+  memset(p, i, CHUNK);
+}
+
+static void
+consume(char *p, int i)
+{
+  if(p[0] != (char)i || p[CHUNK-1] != (char)i)
+    fail("data check");
+}
+
+static int
+pipebench(void)
+{
+  int fds[2], start, n;
+
+  if(pipe(fds) < 0)
+    fail("pipe");
+  start = uptime();
+  int pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    close(fds[0]);
+    for(int i = 0; i < NCHUNK; i++){
+      produce(buf, i);
+      if(write(fds[1], buf, CHUNK) != CHUNK)
+        fail("write");
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  for(int i = 0; i < NCHUNK; i++){
+    for(int got = 0; got < CHUNK; got += n)
+      if((n = read(fds[0], buf + got, CHUNK - got)) <= 0)
+        fail("read");
+    consume(buf, i);
+  }
+  close(fds[0]);
+  wait(0);
+  return uptime() - start;
+}
+
+static int
+shmbench(void)
+{
+  int fd, start;
+  char *ring;
+
+  if((fd = shmcreate(NSLOT * CHUNK)) < 0)
+    fail("shmcreate");
+  ring = mmap(0, NSLOT * CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(ring == (char*)-1)
+    fail("mmap");
+  close(fd);
+  sem_init(SEM_EMPTY, NSLOT);
+  sem_init(SEM_FULL, 0);
+
+  start = uptime();
+  int pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    for(int i = 0; i < NCHUNK; i++){
+      sem_wait(SEM_EMPTY);
+      produce(ring + (i % NSLOT) * CHUNK, i);
+      sem_signal(SEM_FULL);
+    }
+    exit(0);
+  }
+  for(int i = 0; i < NCHUNK; i++){
+    sem_wait(SEM_FULL);
+    consume(ring + (i % NSLOT) * CHUNK, i);
+    sem_signal(SEM_EMPTY);
+  }
+  wait(0);
+  start = uptime() - start;
+  munmap(ring, NSLOT * CHUNK);
+  return start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("shmbench: %d chunks of %d bytes\n", NCHUNK, CHUNK);
+  printf("shmbench: pipe        %d ticks\n", pipebench());
+  printf("shmbench: shm ring    %d ticks\n", shmbench());
+  printf("shmbench: OK\n");
+  exit(0);
+}
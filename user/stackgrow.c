@@ -0,0 +1,87 @@
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+//
+// Check that the user stack grows on demand: recurse through
+// DEPTH frames of about FRAME bytes each, far more than exec()
+// maps, and check every frame on the way back. Then check that
+// a child that recurses without limit is killed at the guard
+// page below USTACKMAX pages, rather than running into the heap.
+//
+
+#define FRAME  1024
+#define DEPTH  2048   // about 2 MiB of stack
+
+static int
+recurse(int n)
+{
+  char buf[FRAME];
+  int sum;
+
+  memset(buf, n & 0xff, sizeof(buf));
+  sum = n ? recurse(n - 1) : 0;
+  if(buf[0] != (char)(n & 0xff) || buf[FRAME-1] != (char)(n & 0xff)){
+    printf("stackgrow: frame %d corrupted\n", n);
+    exit(1);
+  }
+  return sum + buf[FRAME/2];
+}
+
+// recurse through n frames; called with n well past USTACKMAX.
+static int
+deep(int n)
+{
+  volatile char buf[FRAME];
+
+  buf[0] = n;
+  if(n == 0)
+    return 0;
+  return deep(n - 1) + buf[0];
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, xstatus, start;
+
+  start = uptime();
+  recurse(DEPTH);
+  printf("stackgrow: %d frames of %d bytes in %d ticks\n",
+         DEPTH, FRAME, uptime() - start);
+
+  // a forked child gets a copy of the grown stack.
+  pid = fork();
+  if(pid < 0){
+    printf("stackgrow: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    recurse(DEPTH);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("stackgrow: child failed\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("stackgrow: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    deep(2 * USTACKMAX * PGSIZE / FRAME);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("stackgrow: unbounded recursion was not killed\n");
+    exit(1);
+  }
+  printf("stackgrow: OK (stack limit %d KiB)\n", USTACKMAX * PGSIZE / 1024);
+  exit(0);
+}
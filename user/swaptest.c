@@ -0,0 +1,105 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/swap.h"
+#include "user/user.h"
+
+//
+// Overcommit memory and check that it is paged to swap.
+//
+// Grows the heap by NPAGE pages, more than the machine's
+// 128 MiB of RAM, writes a tag to every page and reads them
+// all back twice, so that many pages go out to swap and come
+// back in. Then checks that a child created by fork() sees
+// the parent's swapped-out pages, and prints the counters.
+//
+
+#define NPAGE  (136*1024*1024 / PGSIZE)
+#define NPASS  2
+
+static void
+fail(char *what)
+{
+  printf("swaptest: %s failed\n", what);
+  exit(1);
+}
+
+static uint64
+tag(int i)
+{
+  return i * 0x9e3779b97f4a7c15ULL;
+}
+
+static void
+check(char *mem, int i)
+{
+  uint64 *p = (uint64*)(mem + (uint64)i * PGSIZE);
+
+  if(p[0] != tag(i) || p[PGSIZE/sizeof(uint64) - 1] != ~tag(i))
+    fail("data check");
+}
+
+static void
+stats(char *when)
+{
+  struct swapstat st;
+
+  if(swapstat(&st) < 0)
+    fail("swapstat");
+  printf("swaptest: %s: %d/%d slots in use, %d out, %d in, %d dropped\n",
+         when, st.inuse, st.nslots, (int)st.swapouts, (int)st.swapins,
+         (int)st.drops);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int start, pid, xstatus;
+  char *mem;
+
+  printf("swaptest: %d MiB in %d pages\n", NPAGE / 256, NPAGE);
+  stats("before");
+  mem = sbrk(NPAGE * PGSIZE);
+  if(mem == (char*)-1)
+    fail("sbrk");
+
+  start = uptime();
+  for(int i = 0; i < NPAGE; i++){
+    uint64 *p = (uint64*)(mem + (uint64)i * PGSIZE);
+    p[0] = tag(i);
+    p[PGSIZE/sizeof(uint64) - 1] = ~tag(i);
+  }
+  printf("swaptest: write        %d ticks\n", uptime() - start);
+  stats("after write");
+
+  for(int pass = 0; pass < NPASS; pass++){
+    start = uptime();
+    for(int i = 0; i < NPAGE; i++)
+      check(mem, i);
+    printf("swaptest: read pass %d  %d ticks\n", pass, uptime() - start);
+  }
+  stats("after read");
+
+  // the child shares the parent's pages, whether resident or
+  // in swap. Pages shared with a child can't be reclaimed, so
+  // first give back half the heap, to leave fork() and the
+  // child's swap-ins some memory.
+  sbrk(-(NPAGE/2 * PGSIZE));
+  pid = fork();
+  if(pid < 0)
+    fail("fork");
+  if(pid == 0){
+    for(int i = 0; i < NPAGE/2; i += 509)
+      check(mem, i);
+    exit(0);
+  }
+  if(wait(&xstatus) < 0 || xstatus != 0)
+    fail("fork check");
+  for(int i = 0; i < NPAGE/2; i += 509)
+    check(mem, i);
+
+  sbrk(-(NPAGE/2 * PGSIZE));
+  stats("after free");
+  printf("swaptest: OK\n");
+  exit(0);
+}
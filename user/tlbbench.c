@@ -0,0 +1,71 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/asid.h"
+#include "user/user.h"
+
+//
+// TLB flushes and time for a syscall-heavy loop, with the
+// whole TLB flushed on every trap and with per-process ASIDs.
+//
+// Each iteration makes a getpid() system call and then touches
+// NPAGE pages, which must be found in the page table again if
+// the system call flushed the TLB.
+//
+
+#define NITER 20000
+#define NPAGE 32
+
+static char buf[NPAGE * PGSIZE];
+static uint sink;
+
+static void
+run(int asids)
+{
+  struct tlbstat before, after;
+  int start, t;
+  uint sum = 0;
+
+  if(tlbstat(&before, asids) < 0){
+    printf("tlbbench: tlbstat failed\n");
+    exit(1);
+  }
+  if(asids && !before.on){
+    printf("tlbbench: no ASIDs on this hart\n");
+    return;
+  }
+  start = uptime();
+  for(int i = 0; i < NITER; i++){
+    getpid();
+    for(int j = 0; j < NPAGE; j++)
+      sum += buf[j * PGSIZE];
+  }
+  t = uptime() - start;
+  sink = sum;
+  tlbstat(&after, -1);
+
+  uint64 traps = after.traps - before.traps;
+  uint64 full = after.fullflush - before.fullflush;
+  uint64 asid = after.asidflush - before.asidflush;
+  printf("tlbbench: %s: %d ticks, %d traps, %d full flushes, %d ASID flushes"
+         " (%d per 1000 traps)\n",
+         asids ? "ASIDs   " : "no ASIDs", t, (int)traps, (int)full, (int)asid,
+         (int)((full + asid) * 1000 / (traps ? traps : 1)));
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct tlbstat st;
+
+  for(int j = 0; j < NPAGE; j++)
+    buf[j * PGSIZE] = j;
+  tlbstat(&st, -1);
+  printf("tlbbench: %d ASIDs, %d iterations of getpid() + %d pages\n",
+         st.nasid, NITER, NPAGE);
+  run(0);
+  run(1);
+  tlbstat(&st, st.on);
+  printf("tlbbench: OK\n");
+  exit(0);
+}
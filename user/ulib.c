@@ -158,4 +158,52 @@ ugetpid(void)
   struct usyscall *u = (struct usyscall *)USYSCALL;
   return u->pid;
 }
+
+// Copy the kernel-maintained usyscall page into *u, without a
+// system call. Retry if the kernel was updating the page (odd
+// seq) or updated it while we were copying.
+void
+ugetusyscall(struct usyscall *u)
+{
+  volatile struct usyscall *k = (struct usyscall *)USYSCALL;
+  uint seq;
+
+  do {
+    while((seq = k->seq) & 1)
+      ;
+    __sync_synchronize();
+    memmove(u, (void *)k, sizeof(*u));
+    __sync_synchronize();
+  } while(k->seq != seq);
+}
+
+// uptime() without a system call.
+int
+uuptime(void)
+{
+  struct usyscall u;
+
+  ugetusyscall(&u);
+  return u.ticks;
+}
+
+// the calling process's current priority.
+int
+ugetprio(void)
+{
+  struct usyscall u;
+
+  ugetusyscall(&u);
+  return u.prio;
+}
+
+// the hart the calling process is running on.
+int
+ugethartid(void)
+{
+  struct usyscall u;
+
+  ugetusyscall(&u);
+  return u.hartid;
+}
 #endif
@@ -3,6 +3,16 @@ typedef unsigned long size_t;
 typedef long int off_t;
 #endif
 struct stat;
+struct usyscall;
+struct swapstat;
+struct ksmstat;
+struct tlbstat;
+struct meminfo;
+struct kpoolstat;
+struct bcachestat;
+struct iostat;
+struct logstat;
+struct procmem;
 
 // system calls
 int fork(void);
@@ -55,6 +65,12 @@ void *memcpy(void *, const void *, uint);
 #ifdef LAB_LOCK
 int statistics(void*, int);
 #endif
+#ifdef LAB_PGTBL
+void ugetusyscall(struct usyscall*);
+int uuptime(void);
+int ugetprio(void);
+int ugethartid(void);
+#endif
 
 // umalloc.c
 void* malloc(uint);
@@ -67,3 +83,16 @@ int rw_rlock(int id);
 int rw_runlock(int id);
 int rw_wlock(int id);
 int rw_wunlock(int id);
+void* mmap(void *addr, uint64 len, int prot, int flags, int fd, uint64 off);
+int munmap(void *addr, uint64 len);
+int shmcreate(uint64 size);
+int swapstat(struct swapstat*);
+int ksmstat(struct ksmstat*);
+int tlbstat(struct tlbstat*, int);
+int meminfo(struct meminfo*, struct procmem*, int);
+int kpoolstat(struct kpoolstat*, int);
+int bcachestat(struct bcachestat*, int, int, int, int);
+int diskbench(int, int, int, uint*);
+int iosched(struct iostat*, int, int, int);
+int setprio(int);
+int logstat(struct logstat*, int, int, int);
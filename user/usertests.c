@@ -2404,7 +2404,7 @@ void argptest(char *s)
 }
 
 // check that there's an invalid page beneath
-// the user stack, to catch stack overflow.
+// the user stack's limit, to catch stack overflow.
 void
 stacktest(char *s)
 {
@@ -2414,7 +2414,7 @@ stacktest(char *s)
   pid = fork();
   if(pid == 0) {
     char *sp = (char *) r_sp();
-    sp -= USERSTACK*PGSIZE;
+    sp -= USTACKMAX*PGSIZE;
     // the *sp should cause a trap.
     printf("%s: stacktest: read below stack %d\n", s, *sp);
     exit(1);
@@ -50,3 +50,16 @@ entry("rw_rlock");
 entry("rw_runlock");
 entry("rw_wlock");
 entry("rw_wunlock");
+entry("mmap");
+entry("munmap");
+entry("shmcreate");
+entry("swapstat");
+entry("ksmstat");
+entry("tlbstat");
+entry("meminfo");
+entry("kpoolstat");
+entry("bcachestat");
+entry("diskbench");
+entry("iosched");
+entry("setprio");
+entry("logstat");
@@ -0,0 +1,46 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+//
+// Cost of reading kernel state with a system call versus
+// from the read-only usyscall page the kernel maps into
+// every process (see ugetusyscall() in ulib.c).
+//
+
+#define N 200000
+
+int
+main(int argc, char *argv[])
+{
+  int start, sum = 0;
+
+  printf("vdsobench: %d calls each\n", N);
+
+  start = uptime();
+  for(int i = 0; i < N; i++)
+    sum += uptime();
+  printf("vdsobench: uptime()     %d ticks\n", uptime() - start);
+
+  start = uptime();
+  for(int i = 0; i < N; i++)
+    sum += uuptime();
+  printf("vdsobench: uuptime()    %d ticks\n", uptime() - start);
+
+  start = uptime();
+  for(int i = 0; i < N; i++)
+    sum += getpid();
+  printf("vdsobench: getpid()     %d ticks\n", uptime() - start);
+
+  start = uptime();
+  for(int i = 0; i < N; i++)
+    sum += ugetpid();
+  printf("vdsobench: ugetpid()    %d ticks\n", uptime() - start);
+
+  if(ugetpid() != getpid() || uuptime() > uptime()){
+    printf("vdsobench: usyscall page is stale\n");
+    exit(1);
+  }
+  printf("vdsobench: OK (%d)\n", sum);
+  exit(0);
+}